@@ -12,6 +12,8 @@
 #include "io_gpio.h"
 #include "time.h"
 #include "ota.h"
+#include "socket.h"
+#include "binary.h"
 
 #include <user_interface.h>
 #include <c_types.h>
@@ -29,45 +31,110 @@ typedef struct
 
 static const application_function_table_t application_function_table[];
 
-irom app_action_t application_content(const string_t *src, string_t *dst)
+static const application_function_table_t *application_function_lookup(const string_t *command);
+static void application_profile_add(const application_function_table_t *tableptr, bool_t invocation, uint32_t time_us, int length);
+static bool_t application_profile_generator(string_t *dst, app_generator_state_t *state);
+static void application_profile_reset(void);
+
+static struct
 {
-	string_init(varname_io, "trigger.status.io");
-	string_init(varname_pin, "trigger.status.pin");
+	app_generator_t							*generator;
+	app_generator_state_t					state;
+	const application_function_table_t		*tableptr;
+} application_generator =
+{
+	.generator = (app_generator_t *)0,
+	.tableptr = (const application_function_table_t *)0,
+};
 
+irom app_action_t application_content(const string_t *src, string_t *dst)
+{
 	const application_function_table_t *tableptr;
-	int status_io, status_pin;
+	app_action_t action;
+	uint32_t start;
 
-	if(config_get_int(&varname_io, -1, -1, &status_io) &&
-			config_get_int(&varname_pin, -1, -1, &status_pin) &&
-			(status_io != -1) && (status_pin != -1))
-	{
-		io_trigger_pin((string_t *)0, status_io, status_pin, io_trigger_on);
-	}
+	if((config_int(config_id_trigger_status_io) != -1) && (config_int(config_id_trigger_status_pin) != -1))
+		io_trigger_pin((string_t *)0, config_int(config_id_trigger_status_io), config_int(config_id_trigger_status_pin), io_trigger_on);
+
+	if(binary_is_frame(src))
+		return(binary_content(src, dst));
 
 	if(parse_string(0, src, dst, ' ') != parse_ok)
 		return(app_action_empty);
 
-	for(tableptr = application_function_table; tableptr->function; tableptr++)
-		if(string_match_cstr(dst, tableptr->command1) ||
-				string_match_cstr(dst, tableptr->command2))
-			break;
-
-	if(tableptr->function)
+	if((tableptr = application_function_lookup(dst)))
 	{
 		string_clear(dst);
-		return(tableptr->function(src, dst));
+
+		start = system_get_time();
+		action = tableptr->function(src, dst);
+		application_profile_add(tableptr, true, system_get_time() - start, string_length(dst));
+
+		if(application_generating())
+			application_generator.tableptr = tableptr;
+
+		return(action);
 	}
 
 	string_append(dst, ": command unknown\n");
 	return(app_action_error);
 }
 
-irom static app_action_t application_function_config_dump(const string_t *src, string_t *dst)
+irom app_action_t application_generate(string_t *dst, app_generator_t *generator, int parameter0, int parameter1)
 {
-	config_dump(dst);
+	application_generator.generator = generator;
+	application_generator.tableptr = (const application_function_table_t *)0;
+	application_generator.state.cursor = 0;
+	application_generator.state.parameter[0] = parameter0;
+	application_generator.state.parameter[1] = parameter1;
+
+	return(application_continue(dst));
+}
+
+irom app_action_t application_continue(string_t *dst)
+{
+	uint32_t start;
+	bool_t done;
+
+	if(!application_generator.generator)
+		return(app_action_normal);
+
+	// the time spent on later chunks counts for the command that started it
+
+	start = system_get_time();
+	done = application_generator.generator(dst, &application_generator.state);
+
+	if(application_generator.tableptr)
+		application_profile_add(application_generator.tableptr, false, system_get_time() - start, string_length(dst));
+
+	if(!done)
+		return(app_action_more);
+
+	application_generator.generator = (app_generator_t *)0;
+
 	return(app_action_normal);
 }
 
+irom bool_t application_generating(void)
+{
+	return(!!application_generator.generator);
+}
+
+irom void application_generate_cancel(void)
+{
+	application_generator.generator = (app_generator_t *)0;
+}
+
+irom static bool_t application_config_dump_generator(string_t *dst, app_generator_state_t *state)
+{
+	return(config_dump(dst, &state->cursor));
+}
+
+irom static app_action_t application_function_config_dump(const string_t *src, string_t *dst)
+{
+	return(application_generate(dst, application_config_dump_generator, 0, 0));
+}
+
 irom static app_action_t application_function_config_write(const string_t *src, string_t *dst)
 {
 	unsigned int size;
@@ -212,16 +279,29 @@ irom static app_action_t application_function_config_delete(const string_t *src,
 	return(app_action_normal);
 }
 
-irom static app_action_t application_function_help(const string_t *src, string_t *dst)
+irom static bool_t application_help_generator(string_t *dst, app_generator_state_t *state)
 {
 	const application_function_table_t *tableptr;
+	int mark;
+
+	for(tableptr = &application_function_table[state->cursor]; tableptr->function; tableptr++, state->cursor++)
+	{
+		mark = string_length(dst);
 
-	for(tableptr = application_function_table; tableptr->function; tableptr++)
 		string_format(dst, "> %s/%s: %s\n",
 				tableptr->command1, tableptr->command2,
 				tableptr->description);
 
-	return(app_action_normal);
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+	}
+
+	return(true);
+}
+
+irom static app_action_t application_function_help(const string_t *src, string_t *dst)
+{
+	return(application_generate(dst, application_help_generator, 0, 0));
 }
 
 irom static app_action_t application_function_identification(const string_t *src, string_t *dst)
@@ -299,6 +379,20 @@ irom static app_action_t application_function_stats_i2c(const string_t *src, str
 	return(app_action_normal);
 }
 
+irom static app_action_t application_function_stats_profile(const string_t *src, string_t *dst)
+{
+	string_new(stack, argument, 16);
+
+	if((parse_string(1, src, &argument, ' ') == parse_ok) && string_match_cstr(&argument, "reset"))
+	{
+		application_profile_reset();
+		string_append(dst, "> profile reset\n");
+		return(app_action_normal);
+	}
+
+	return(application_generate(dst, application_profile_generator, 0, 0));
+}
+
 irom static app_action_t application_function_stats_wlan(const string_t *src, string_t *dst)
 {
 	stats_wlan(dst);
@@ -308,7 +402,6 @@ irom static app_action_t application_function_stats_wlan(const string_t *src, st
 irom static app_action_t application_function_bridge_port(const string_t *src, string_t *dst)
 {
 	int port;
-	string_init(varname_bridgeport, "bridge.port");
 
 	if(parse_int(1, src, &port, 0, ' ') == parse_ok)
 	{
@@ -318,18 +411,14 @@ irom static app_action_t application_function_bridge_port(const string_t *src, s
 			return(app_action_error);
 		}
 
-		if(port == 0)
-			config_delete(&varname_bridgeport, -1, -1, false);
-		else
-			if(!config_set_int(&varname_bridgeport, -1, -1, port))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_bridge_port, port))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_bridgeport, -1, -1, &port))
-		port = 0;
+	port = config_int(config_id_bridge_port);
 
 	string_format(dst, "> port: %d\n", port);
 
@@ -338,7 +427,6 @@ irom static app_action_t application_function_bridge_port(const string_t *src, s
 
 irom static app_action_t application_function_bridge_timeout(const string_t *src, string_t *dst)
 {
-	string_init(varname_bridgetimeout, "bridge.timeout");
 	int timeout;
 
 	if(parse_int(1, src, &timeout, 0, ' ') == parse_ok)
@@ -349,27 +437,247 @@ irom static app_action_t application_function_bridge_timeout(const string_t *src
 			return(app_action_error);
 		}
 
-		if(timeout == 90)
-			config_delete(&varname_bridgetimeout, -1, -1, false);
+		if(!config_set_int_id(config_id_bridge_timeout, timeout))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+	}
+
+	timeout = config_int(config_id_bridge_timeout);
+
+	string_format(dst, "> timeout: %d\n", timeout);
+
+	return(app_action_normal);
+}
+
+irom static app_action_t application_function_bridge_coalesce(const string_t *src, string_t *dst)
+{
+	int bytes, time_us;
+
+	if(parse_int(1, src, &bytes, 0, ' ') == parse_ok)
+	{
+		if((bytes < 0) || (bytes > uart_bridge_max_send_length))
+		{
+			string_format(dst, "> invalid coalesce bytes: %d\n", bytes);
+			return(app_action_error);
+		}
+
+		if(parse_int(2, src, &time_us, 0, ' ') != parse_ok)
+			time_us = 0;
+
+		if((time_us < 0) || (time_us > 10000000))
+		{
+			string_format(dst, "> invalid coalesce time: %d\n", time_us);
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_bridge_coalesce_bytes, bytes))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_bridge_coalesce_time, time_us))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+	}
+
+	bytes = config_int(config_id_bridge_coalesce_bytes);
+
+	time_us = config_int(config_id_bridge_coalesce_time);
+
+	string_format(dst, "> coalesce bytes: %d, time: %d us\n", bytes, time_us);
+
+	return(app_action_normal);
+}
+
+irom static app_action_t application_function_bridge_framing(const string_t *src, string_t *dst)
+{
+	static const char *framing_mode_name[] = { "none", "idle", "delimiter" };
+
+	int mode, value;
+
+	if(parse_string(1, src, dst, ' ') == parse_ok)
+	{
+		if(string_match_cstr(dst, "none"))
+			mode = bridge_framing_none;
+		else if(string_match_cstr(dst, "idle"))
+			mode = bridge_framing_idle;
+		else if(string_match_cstr(dst, "delimiter"))
+			mode = bridge_framing_delimiter;
 		else
-			if(!config_set_int(&varname_bridgetimeout, -1, -1, timeout))
+		{
+			string_append(dst, ": invalid framing mode, use none, idle <gap> or delimiter <byte>\n");
+			return(app_action_error);
+		}
+
+		string_clear(dst);
+
+		if(!config_set_int_id(config_id_bridge_framing_mode, mode))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		if(parse_int(2, src, &value, 0, ' ') == parse_ok)
+		{
+			if(mode == bridge_framing_idle)
+			{
+				if((value < 1) || (value > 127))
+				{
+					string_format(dst, "> invalid gap: %d\n", value);
+					return(app_action_error);
+				}
+
+				if(!config_set_int_id(config_id_bridge_framing_gap, value))
+				{
+					string_append(dst, "> cannot set config\n");
+					return(app_action_error);
+				}
+			}
+
+			if(mode == bridge_framing_delimiter)
+			{
+				if((value < 0) || (value > 255))
+				{
+					string_format(dst, "> invalid delimiter: %d\n", value);
+					return(app_action_error);
+				}
+
+				if(!config_set_int_id(config_id_bridge_framing_delimiter, value))
+				{
+					string_append(dst, "> cannot set config\n");
+					return(app_action_error);
+				}
+			}
+		}
+	}
+
+	string_clear(dst);
+
+	mode = config_int(config_id_bridge_framing_mode);
+
+	if((mode < bridge_framing_none) || (mode > bridge_framing_delimiter))
+		mode = bridge_framing_none;
+
+	string_format(dst, "> framing: %s", framing_mode_name[mode]);
+
+	if(mode == bridge_framing_idle)
+	{
+		value = config_int(config_id_bridge_framing_gap);
+
+		string_format(dst, ", gap: %d characters", value);
+	}
+
+	if(mode == bridge_framing_delimiter)
+	{
+		value = config_int(config_id_bridge_framing_delimiter);
+
+		string_format(dst, ", delimiter: %d", value);
+	}
+
+	string_append(dst, "\n");
+
+	return(app_action_normal);
+}
+
+irom static app_action_t application_function_bridge_clients(const string_t *src, string_t *dst)
+{
+	static const char *writers_name[] = { "first", "all", "designated" };
+
+	int clients, writers, ix;
+	ip_addr_to_bytes_t a2b;
+
+	if(parse_int(1, src, &clients, 0, ' ') == parse_ok)
+	{
+		if((clients < 1) || (clients > socket_max_children))
+		{
+			string_format(dst, "> invalid number of clients: %d\n", clients);
+			return(app_action_error);
+		}
+
+		writers = bridge_writers_first;
+
+		if(parse_string(2, src, dst, ' ') == parse_ok)
+		{
+			if(string_match_cstr(dst, "first"))
+				writers = bridge_writers_first;
+			else if(string_match_cstr(dst, "all"))
+				writers = bridge_writers_all;
+			else if(string_match_cstr(dst, "designated"))
+				writers = bridge_writers_designated;
+			else
+			{
+				string_append(dst, ": invalid writers, use first, all or designated <ip>\n");
+				return(app_action_error);
+			}
+		}
+
+		string_clear(dst);
+
+		if(writers == bridge_writers_designated)
+		{
+			if(parse_string(3, src, dst, ' ') != parse_ok)
+			{
+				string_clear(dst);
+				string_append(dst, "> designated writer needs an ip address\n");
+				return(app_action_error);
+			}
+
+			a2b.ip_addr = ip_addr(string_to_cstr(dst));
+			string_clear(dst);
+
+		}
+		else
+			a2b.ip_addr.addr = 0;
+
+		for(ix = 0; ix < 4; ix++)
+			if(!config_set_int_id((config_id_t)(config_id_bridge_writer_ip_0 + ix), a2b.byte[ix]))
 			{
 				string_append(dst, "> cannot set config\n");
 				return(app_action_error);
 			}
+
+		if(!config_set_int_id(config_id_bridge_clients, clients))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_bridge_writers, writers))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_bridgetimeout, -1, -1, &timeout))
-		timeout = 90;
+	clients = config_int(config_id_bridge_clients);
 
-	string_format(dst, "> timeout: %d\n", timeout);
+	writers = config_int(config_id_bridge_writers);
+
+	if((writers < bridge_writers_first) || (writers > bridge_writers_designated))
+		writers = bridge_writers_first;
+
+	string_format(dst, "> clients: %d, writers: %s", clients, writers_name[writers]);
+
+	if(writers == bridge_writers_designated)
+	{
+		for(ix = 0; ix < 4; ix++)
+			a2b.byte[ix] = (uint8_t)config_int((config_id_t)(config_id_bridge_writer_ip_0 + ix));
+
+		string_format(dst, " (%u.%u.%u.%u)", a2b.byte[0], a2b.byte[1], a2b.byte[2], a2b.byte[3]);
+	}
+
+	string_append(dst, "\n");
 
 	return(app_action_normal);
 }
 
 irom static app_action_t application_function_command_port(const string_t *src, string_t *dst)
 {
-	string_init(varname_cmdport, "cmd.port");
 	int port;
 
 	if(parse_int(1, src, &port, 0, ' ') == parse_ok)
@@ -380,18 +688,14 @@ irom static app_action_t application_function_command_port(const string_t *src,
 			return(app_action_error);
 		}
 
-		if(port == 24)
-			config_delete(&varname_cmdport, -1, -1, false);
-		else
-			if(!config_set_int(&varname_cmdport, -1, -1, port))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_cmd_port, port))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_cmdport, -1, -1, &port))
-		port = 24;
+	port = config_int(config_id_cmd_port);
 
 	string_format(dst, "> port: %d\n", port);
 
@@ -400,7 +704,6 @@ irom static app_action_t application_function_command_port(const string_t *src,
 
 irom static app_action_t application_function_command_timeout(const string_t *src, string_t *dst)
 {
-	string_init(varname_cmdtimeout, "cmd.timeout");
 	int timeout;
 
 	if(parse_int(1, src, &timeout, 0, ' ') == parse_ok)
@@ -411,18 +714,14 @@ irom static app_action_t application_function_command_timeout(const string_t *sr
 			return(app_action_error);
 		}
 
-		if(timeout == 90)
-			config_delete(&varname_cmdtimeout, -1, -1, false);
-		else
-			if(!config_set_int(&varname_cmdtimeout, -1, -1, timeout))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_cmd_timeout, timeout))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_cmdtimeout, -1, -1, &timeout))
-		timeout = 90;
+	timeout = config_int(config_id_cmd_timeout);
 
 	string_format(dst, "> timeout: %d\n", timeout);
 
@@ -431,7 +730,6 @@ irom static app_action_t application_function_command_timeout(const string_t *sr
 
 irom static app_action_t application_function_uart_baud_rate(const string_t *src, string_t *dst)
 {
-	string_init(varname_baudrate, "uart.baud");
 	int baud_rate;
 
 	if(parse_int(1, src, &baud_rate, 0, ' ') == parse_ok)
@@ -442,18 +740,14 @@ irom static app_action_t application_function_uart_baud_rate(const string_t *src
 			return(app_action_error);
 		}
 
-		if(baud_rate == 9600)
-			config_delete(&varname_baudrate, -1, -1, false);
-		else
-			if(!config_set_int(&varname_baudrate, -1, -1, baud_rate))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_uart_baud, baud_rate))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_baudrate, -1, -1, &baud_rate))
-		baud_rate = 9600;
+	baud_rate = config_int(config_id_uart_baud);
 
 	string_format(dst, "> baudrate: %d\n", baud_rate);
 
@@ -463,7 +757,6 @@ irom static app_action_t application_function_uart_baud_rate(const string_t *src
 irom static app_action_t application_function_uart_data_bits(const string_t *src, string_t *dst)
 {
 	int data_bits;
-	string_init(varname_uartbits, "uart.bits");
 
 	if(parse_int(1, src, &data_bits, 0, ' ') == parse_ok)
 	{
@@ -473,18 +766,14 @@ irom static app_action_t application_function_uart_data_bits(const string_t *src
 			return(app_action_error);
 		}
 
-		if(data_bits == 8)
-			config_delete(&varname_uartbits, -1, -1, false);
-		else
-			if(!config_set_int(&varname_uartbits, -1, -1, data_bits))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_uart_bits, data_bits))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_uartbits, -1, -1, &data_bits))
-		data_bits = 8;
+	data_bits = config_int(config_id_uart_bits);
 
 	string_format(dst, "data bits: %d\n", data_bits);
 
@@ -494,7 +783,6 @@ irom static app_action_t application_function_uart_data_bits(const string_t *src
 irom static app_action_t application_function_uart_stop_bits(const string_t *src, string_t *dst)
 {
 	int stop_bits;
-	string_init(varname_stopbits, "uart.stop");
 
 	if(parse_int(1, src, &stop_bits, 0, ' ') == parse_ok)
 	{
@@ -504,29 +792,72 @@ irom static app_action_t application_function_uart_stop_bits(const string_t *src
 			return(app_action_error);
 		}
 
-		if(stop_bits == 1)
-			config_delete(&varname_stopbits, -1, -1, false);
-		else
-			if(!config_set_int(&varname_stopbits, -1, -1, stop_bits))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_uart_stop, stop_bits))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_stopbits, -1, -1, &stop_bits))
-		stop_bits = 1;
+	stop_bits = config_int(config_id_uart_stop);
 
 	string_format(dst, "> stop bits: %d\n", stop_bits);
 
 	return(app_action_normal);
 }
 
+irom static app_action_t application_function_uart_fifo(const string_t *src, string_t *dst)
+{
+	int rx_full, rx_timeout, tx_empty;
+
+	if(parse_int(1, src, &rx_full, 0, ' ') == parse_ok)
+	{
+		if(parse_int(2, src, &rx_timeout, 0, ' ') != parse_ok)
+			rx_timeout = 0;
+
+		if(parse_int(3, src, &tx_empty, 0, ' ') != parse_ok)
+			tx_empty = 0;
+
+		if((rx_full < 0) || (rx_full > 127) || (rx_timeout < 0) || (rx_timeout > 127) || (tx_empty < 0) || (tx_empty > 127))
+		{
+			string_append(dst, "> invalid threshold, use 1-127 or 0 for automatic\n");
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_uart_rx_full, rx_full))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_uart_rx_timeout, rx_timeout))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		if(!config_set_int_id(config_id_uart_tx_empty, tx_empty))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
+
+		uart_fifo_thresholds(rx_full, rx_timeout, tx_empty);
+	}
+
+	string_append(dst, "> ");
+	uart_fifo_to_string(dst);
+	string_append(dst, "\n> ");
+	uart_flow_to_string(dst);
+	string_append(dst, "\n");
+
+	return(app_action_normal);
+}
+
 irom static app_action_t application_function_uart_parity(const string_t *src, string_t *dst)
 {
 	uart_parity_t parity;
 	int parity_int;
-	string_init(varname_parity, "uart.parity");
 
 	if(parse_string(1, src, dst, ' ') == parse_ok)
 	{
@@ -538,24 +869,15 @@ irom static app_action_t application_function_uart_parity(const string_t *src, s
 			return(app_action_error);
 		}
 
-		if(parity == parity_none)
-			config_delete(&varname_parity, -1, -1, false);
-		else
+		if(!config_set_int_id(config_id_uart_parity, (int)parity))
 		{
-			parity_int = (int)parity;
-
-			if(!config_set_int(&varname_parity, -1, -1, parity_int))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
 		}
 	}
 
-	if(config_get_int(&varname_parity, -1, -1, &parity_int))
-		parity = (uart_parity_t)parity_int;
-	else
-		parity = parity_none;
+	parity_int = config_int(config_id_uart_parity);
+	parity = (uart_parity_t)parity_int;
 
 	string_clear(dst);
 	string_append(dst, "parity: ");
@@ -1038,9 +1360,6 @@ irom static app_action_t application_function_wlan_ap_configure(const string_t *
 	int channel;
 	string_new(stack, ssid, 64);
 	string_new(stack, passwd, 64);
-	string_init(varname_wlan_ap_ssid, "wlan.ap.ssid");
-	string_init(varname_wlan_ap_passwd, "wlan.ap.passwd");
-	string_init(varname_wlan_ap_channel, "wlan.ap.channel");
 
 	if((parse_string(1, src, &ssid, ' ') == parse_ok) && (parse_string(2, src, &passwd, ' ') == parse_ok) &&
 			(parse_int(3, src, &channel, 0, ' ') == parse_ok))
@@ -1058,19 +1377,19 @@ irom static app_action_t application_function_wlan_ap_configure(const string_t *
 			return(app_action_error);
 		}
 
-		if(!config_set_string(&varname_wlan_ap_ssid, -1, -1, &ssid, -1, -1))
+		if(!config_set_string_id(config_id_wlan_ap_ssid, &ssid))
 		{
 			string_append(dst, "> cannot set config\n");
 			return(app_action_error);
 		}
 
-		if(!config_set_string(&varname_wlan_ap_passwd, -1, -1, &passwd, -1, -1))
+		if(!config_set_string_id(config_id_wlan_ap_passwd, &passwd))
 		{
 			string_append(dst, "> cannot set config\n");
 			return(app_action_error);
 		}
 
-		if(!config_set_int(&varname_wlan_ap_channel, -1, -1, channel))
+		if(!config_set_int_id(config_id_wlan_ap_channel, channel))
 		{
 			string_append(dst, "> cannot set config\n");
 			return(app_action_error);
@@ -1080,20 +1399,10 @@ irom static app_action_t application_function_wlan_ap_configure(const string_t *
 	string_clear(&ssid);
 	string_clear(&passwd);
 
-	if(!config_get_string(&varname_wlan_ap_ssid, -1, -1, &ssid))
-	{
-		string_clear(&ssid);
-		string_append(&ssid, "<empty>");
-	}
-
-	if(!config_get_string(&varname_wlan_ap_passwd, -1, -1, &passwd))
-	{
-		string_clear(&passwd);
-		string_append(&passwd, "<empty>");
-	}
+	config_get_string_id(config_id_wlan_ap_ssid, &ssid);
+	config_get_string_id(config_id_wlan_ap_passwd, &passwd);
 
-	if(!config_get_int(&varname_wlan_ap_channel, -1, -1, &channel))
-		channel = 0;
+	channel = config_int(config_id_wlan_ap_channel);
 
 	string_format(dst, "> ssid: \"%s\", passwd: \"%s\", channel: %d\n",
 			string_to_cstr(&ssid), string_to_cstr(&passwd), channel);
@@ -1105,8 +1414,6 @@ irom static app_action_t application_function_wlan_client_configure(const string
 {
 	string_new(stack, ssid, 64);
 	string_new(stack, passwd, 64);
-	string_init(varname_wlan_client_ssid, "wlan.client.ssid");
-	string_init(varname_wlan_client_passwd, "wlan.client.passwd");
 
 	if((parse_string(1, src, &ssid, ' ') == parse_ok) && (parse_string(2, src, &passwd, ' ') == parse_ok))
 	{
@@ -1116,13 +1423,13 @@ irom static app_action_t application_function_wlan_client_configure(const string
 			return(app_action_error);
 		}
 
-		if(!config_set_string(&varname_wlan_client_ssid, -1, -1, &ssid, -1, -1))
+		if(!config_set_string_id(config_id_wlan_client_ssid, &ssid))
 		{
 			string_append(dst, "> cannot set config\n");
 			return(app_action_error);
 		}
 
-		if(!config_set_string(&varname_wlan_client_passwd, -1, -1, &passwd, -1, -1))
+		if(!config_set_string_id(config_id_wlan_client_passwd, &passwd))
 		{
 			string_append(dst, "> cannot set config\n");
 			return(app_action_error);
@@ -1132,17 +1439,8 @@ irom static app_action_t application_function_wlan_client_configure(const string
 	string_clear(&ssid);
 	string_clear(&passwd);
 
-	if(!config_get_string(&varname_wlan_client_ssid, -1, -1, &ssid))
-	{
-		string_clear(&ssid);
-		string_append(&ssid, "<empty>");
-	}
-
-	if(!config_get_string(&varname_wlan_client_passwd, -1, -1, &passwd))
-	{
-		string_clear(&passwd);
-		string_append(&passwd, "<empty>");
-	}
+	config_get_string_id(config_id_wlan_client_ssid, &ssid);
+	config_get_string_id(config_id_wlan_client_passwd, &passwd);
 
 	string_format(dst, "> ssid: \"%s\", passwd: \"%s\"\n",
 			string_to_cstr(&ssid), string_to_cstr(&passwd));
@@ -1152,9 +1450,8 @@ irom static app_action_t application_function_wlan_client_configure(const string
 
 irom static app_action_t application_function_wlan_mode(const string_t *src, string_t *dst)
 {
-	unsigned int int_mode;
 	config_wlan_mode_t mode;
-	string_init(varname_wlan_mode, "wlan.mode");
+	int mode_int;
 
 	if(parse_string(1, src, dst, ' ') == parse_ok)
 	{
@@ -1162,7 +1459,7 @@ irom static app_action_t application_function_wlan_mode(const string_t *src, str
 		{
 			string_clear(dst);
 
-			if(!config_set_int(&varname_wlan_mode, -1, -1, config_wlan_mode_client))
+			if(!config_set_int_id(config_id_wlan_mode, config_wlan_mode_client))
 			{
 				string_append(dst, "> cannot set config\n");
 				return(app_action_error);
@@ -1181,7 +1478,7 @@ irom static app_action_t application_function_wlan_mode(const string_t *src, str
 		{
 			string_clear(dst);
 
-			if(!config_set_int(&varname_wlan_mode, -1, -1, config_wlan_mode_ap))
+			if(!config_set_int_id(config_id_wlan_mode, config_wlan_mode_ap))
 			{
 				string_append(dst, "> cannot set config\n");
 				return(app_action_error);
@@ -1203,33 +1500,29 @@ irom static app_action_t application_function_wlan_mode(const string_t *src, str
 	string_clear(dst);
 	string_append(dst, "> current mode: ");
 
-	if(config_get_int(&varname_wlan_mode, -1, -1, &int_mode))
-	{
-		mode = (config_wlan_mode_t)int_mode;
+	mode_int = config_int(config_id_wlan_mode);
+	mode = (config_wlan_mode_t)mode_int;
 
-		switch(mode)
+	switch(mode)
+	{
+		case(config_wlan_mode_client):
 		{
-			case(config_wlan_mode_client):
-			{
-				string_append(dst, "client mode");
-				break;
-			}
+			string_append(dst, "client mode");
+			break;
+		}
 
-			case(config_wlan_mode_ap):
-			{
-				string_append(dst, "ap mode");
-				break;
-			}
+		case(config_wlan_mode_ap):
+		{
+			string_append(dst, "ap mode");
+			break;
+		}
 
-			default:
-			{
-				string_append(dst, "unknown mode");
-				break;
-			}
+		default:
+		{
+			string_append(dst, "unknown mode");
+			break;
 		}
 	}
-	else
-		string_append(dst, "mode unset");
 
 	string_append(dst, "\n");
 
@@ -1295,7 +1588,6 @@ irom static app_action_t application_function_ntp_set(const string_t *src, strin
 
 	string_new(stack, ip, 32);
 	string_init(varname_ntp_server, "ntp.server.%u");
-	string_init(varname_ntp_tz, "ntp.tz");
 
 	if((parse_string(1, src, &ip, ' ') == parse_ok) && (parse_int(2, src, &timezone, 0, ' ') == parse_ok))
 	{
@@ -1313,15 +1605,12 @@ irom static app_action_t application_function_ntp_set(const string_t *src, strin
 					return(app_action_error);
 				}
 
-		if(timezone == 0)
-			config_delete(&varname_ntp_tz, -1, -1, false);
-		else
-			if(!config_set_int(&varname_ntp_tz, -1, -1, timezone))
-			{
-				string_clear(dst);
-				string_append(dst, "cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_ntp_tz, timezone))
+		{
+			string_clear(dst);
+			string_append(dst, "cannot set config\n");
+			return(app_action_error);
+		}
 
 		time_ntp_init();
 	}
@@ -1332,8 +1621,6 @@ irom static app_action_t application_function_ntp_set(const string_t *src, strin
 irom static app_action_t application_function_gpio_status_set(const string_t *src, string_t *dst)
 {
 	int trigger_io, trigger_pin;
-	string_init(varname_trig_stat_io, "trigger.status.io");
-	string_init(varname_trig_stat_pin, "trigger.status.pin");
 
 	if((parse_int(1, src, &trigger_io, 0, ' ') == parse_ok) && (parse_int(2, src, &trigger_pin, 0, ' ') == parse_ok))
 	{
@@ -1345,23 +1632,21 @@ irom static app_action_t application_function_gpio_status_set(const string_t *sr
 
 		if((trigger_io < 0) || (trigger_pin < 0))
 		{
-			config_delete(&varname_trig_stat_io, -1, -1, false);
-			config_delete(&varname_trig_stat_pin, -1, -1, false);
+			trigger_io = -1;
+			trigger_pin = -1;
+		}
+
+		if(!config_set_int_id(config_id_trigger_status_io, trigger_io) ||
+				!config_set_int_id(config_id_trigger_status_pin, trigger_pin))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
 		}
-		else
-			if(!config_set_int(&varname_trig_stat_io, -1, -1, trigger_io) ||
-					!config_set_int(&varname_trig_stat_pin, -1, -1, trigger_pin))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
 	}
 
-	if(!config_get_int(&varname_trig_stat_io, -1, -1, &trigger_io))
-		trigger_io = -1;
+	trigger_io = config_int(config_id_trigger_status_io);
 
-	if(!config_get_int(&varname_trig_stat_pin, -1, -1, &trigger_pin))
-		trigger_pin = -1;
+	trigger_pin = config_int(config_id_trigger_status_pin);
 
 	string_format(dst, "status trigger at io %d/%d (-1 is disabled)\n",
 			trigger_io, trigger_pin);
@@ -1372,8 +1657,6 @@ irom static app_action_t application_function_gpio_status_set(const string_t *sr
 irom static app_action_t application_function_gpio_assoc_set(const string_t *src, string_t *dst)
 {
 	int trigger_io, trigger_pin;
-	string_init(varname_trig_assoc_io, "trigger.assoc.io");
-	string_init(varname_trig_assoc_pin, "trigger.assoc.pin");
 
 	if((parse_int(1, src, &trigger_io, 0, ' ') == parse_ok) && (parse_int(2, src, &trigger_pin, 0, ' ') == parse_ok))
 	{
@@ -1385,23 +1668,21 @@ irom static app_action_t application_function_gpio_assoc_set(const string_t *src
 
 		if((trigger_io < 0) || (trigger_pin < 0))
 		{
-			config_delete(&varname_trig_assoc_io, -1, -1, false);
-			config_delete(&varname_trig_assoc_pin, -1, -1, false);
+			trigger_io = -1;
+			trigger_pin = -1;
+		}
+
+		if(!config_set_int_id(config_id_trigger_assoc_io, trigger_io) ||
+				!config_set_int_id(config_id_trigger_assoc_pin, trigger_pin))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
 		}
-		else
-			if(!config_set_int(&varname_trig_assoc_io, -1, -1, trigger_io) ||
-					!config_set_int(&varname_trig_assoc_pin, -1, -1, trigger_pin))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
 	}
 
-	if(!config_get_int(&varname_trig_assoc_io, -1, -1, &trigger_io))
-		trigger_io = -1;
+	trigger_io = config_int(config_id_trigger_assoc_io);
 
-	if(!config_get_int(&varname_trig_assoc_pin, -1, -1, &trigger_pin))
-		trigger_pin = -1;
+	trigger_pin = config_int(config_id_trigger_assoc_pin);
 
 	string_format(dst, "wlan association trigger at io %d/%d (-1 is disabled)\n",
 			trigger_io, trigger_pin);
@@ -1446,6 +1727,124 @@ irom static app_action_t application_function_poke(const string_t *src, string_t
 	return(app_action_normal);
 }
 
+// Commands that end the connection, reset or take raw data can't be run
+// from a batch, neither can a batch itself.
+
+irom static app_action_t application_function_batch(const string_t *src, string_t *dst);
+
+irom static bool_t application_batch_allowed(const application_function_table_t *tableptr)
+{
+	return((tableptr->function != application_function_batch) &&
+			(tableptr->function != application_function_quit) &&
+			(tableptr->function != application_function_reset) &&
+			(tableptr->function != application_function_wlan_mode) &&
+			(tableptr->function != application_function_http_get) &&
+			(tableptr->function != application_function_ota_send) &&
+			(tableptr->function != application_function_ota_commit) &&
+			(tableptr->function != application_function_flash_send));
+}
+
+irom static app_action_t application_function_batch(const string_t *src, string_t *dst)
+{
+	static const char *status_name[] = { "ok", "error", "empty" };
+
+	const application_function_table_t *tableptr;
+	int offset, count, errors;
+	app_action_t action;
+	string_t reply;
+	char current;
+
+	string_new(stack, command, 256);
+	string_new(stack, name, 32);
+
+	if((offset = string_sep(src, 0, 1, ' ')) < 0)
+	{
+		string_append(dst, "> usage: batch <command>[; <command>...]\n");
+		return(app_action_error);
+	}
+
+	count = 0;
+	errors = 0;
+
+	while(offset < string_length(src))
+	{
+		string_clear(&command);
+
+		for(; offset < string_length(src); offset++)
+		{
+			current = string_at(src, offset);
+
+			if(current == ';')
+			{
+				offset++;
+				break;
+			}
+
+			if(!string_empty(&command) || (current > ' '))
+				string_append_char(&command, current);
+		}
+
+		string_clear(&name);
+
+		if(parse_string(0, &command, &name, ' ') != parse_ok)
+			continue;
+
+		if(string_empty(&name))
+			continue;
+
+		if((string_size(dst) - string_length(dst)) < 64)
+		{
+			string_format(dst, "> batch: out of space after %d commands\n", count);
+			return(app_action_error);
+		}
+
+		count++;
+
+		if(!(tableptr = application_function_lookup(&name)) || !application_batch_allowed(tableptr))
+		{
+			string_format(dst, "> [%d] refused: ", count);
+			string_append_string(dst, &name);
+			string_append(dst, "\n");
+			errors++;
+			continue;
+		}
+
+		// run the command in the free space of dst, then move its output
+		// down to make room for the status line in front of it
+
+		string_set(&reply, string_buffer_nonconst(dst) + string_length(dst), string_size(dst) - string_length(dst), 0);
+		action = application_content(&command, &reply);
+
+		// output that doesn't fit in one chunk is cut short here
+
+		if(action == app_action_more)
+		{
+			application_generate_cancel();
+			action = app_action_normal;
+		}
+
+		if((action != app_action_normal) && (action != app_action_error) && (action != app_action_empty))
+			action = app_action_error;
+
+		if(action == app_action_error)
+			errors++;
+
+		string_clear(&name);
+		string_format(&name, "> [%d] %s\n", count, status_name[action]);
+
+		if((string_length(dst) + string_length(&name) + string_length(&reply)) > string_size(dst))
+			string_setlength(&reply, string_size(dst) - string_length(dst) - string_length(&name));
+
+		memmove(string_buffer_nonconst(dst) + string_length(dst) + string_length(&name), string_buffer(&reply), string_length(&reply));
+		memcpy(string_buffer_nonconst(dst) + string_length(dst), string_buffer(&name), string_length(&name));
+		string_setlength(dst, string_length(dst) + string_length(&name) + string_length(&reply));
+	}
+
+	string_format(dst, "> batch: %d commands, %d errors\n", count, errors);
+
+	return(errors ? app_action_error : app_action_normal);
+}
+
 static const application_function_table_t application_function_table[] =
 {
 	{
@@ -1463,6 +1862,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_reset,
 		"reset",
 	},
+	{
+		"b", "batch",
+		application_function_batch,
+		"batch <command>[; <command>...], run commands in one go, a status line precedes each reply",
+	},
 	{
 		"id", "identification",
 		application_function_identification,
@@ -1493,6 +1897,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_stats_wlan,
 		"stats (wlan)",
 	},
+	{
+		"sp", "stats-profile",
+		application_function_stats_profile,
+		"stats (time and reply size per command) [reset]",
+	},
 	{
 		"bp", "bridge-port",
 		application_function_bridge_port,
@@ -1503,6 +1912,21 @@ static const application_function_table_t application_function_table[] =
 		application_function_bridge_timeout,
 		"set uart bridge tcp connection timeout (default 0)"
 	},
+	{
+		"bc", "bridge-coalesce",
+		application_function_bridge_coalesce,
+		"set uart bridge coalescing <bytes> <time_us>, send when either is reached (default 0 = max, 0 = no wait)"
+	},
+	{
+		"bf", "bridge-framing",
+		application_function_bridge_framing,
+		"set uart bridge framing, one frame per packet [none / idle <gap in characters> / delimiter <byte>] (default none)"
+	},
+	{
+		"bcl", "bridge-clients",
+		application_function_bridge_clients,
+		"set uart bridge clients (1-4, default 1) and who may write [first / all / designated <ip>] (default first)"
+	},
 	{
 		"cp", "command-port",
 		application_function_command_port,
@@ -1688,6 +2112,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_uart_parity,
 		"set uart parity [none/even/odd]",
 	},
+	{
+		"uf", "uart-fifo",
+		application_function_uart_fifo,
+		"set uart fifo thresholds <rx full> <rx timeout> <tx empty> [1-127, 0 = automatic]",
+	},
 	{
 		"wac", "wlan-ap-configure",
 		application_function_wlan_ap_configure,
@@ -1834,3 +2263,175 @@ static const application_function_table_t application_function_table[] =
 		"",
 	},
 };
+
+/*
+ * Both names of every command are kept in an index sorted on length, then
+ * contents, so a command is found with a binary search. The index is built
+ * from the table at startup, the table itself stays in the order of the
+ * help output.
+ */
+
+typedef struct
+{
+	const char	*name;
+	uint16_t	length;
+	uint16_t	entry;
+} application_index_t;
+
+static application_index_t application_index[2 * (sizeof(application_function_table) / sizeof(*application_function_table))];
+static int application_index_length = 0;
+
+irom static int application_index_compare(const char *name1, int length1, const char *name2, int length2)
+{
+	if(length1 != length2)
+		return(length1 - length2);
+
+	return(memcmp(name1, name2, length1));
+}
+
+irom static void application_index_add(const char *name, int entry)
+{
+	int ix;
+
+	// insertion sort, equal names stay in table order so the first one wins
+
+	for(ix = application_index_length; ix > 0; ix--)
+	{
+		if(application_index_compare(application_index[ix - 1].name, application_index[ix - 1].length, name, strlen(name)) <= 0)
+			break;
+
+		application_index[ix] = application_index[ix - 1];
+	}
+
+	application_index[ix].name = name;
+	application_index[ix].length = strlen(name);
+	application_index[ix].entry = entry;
+
+	application_index_length++;
+}
+
+irom void application_init(void)
+{
+	const application_function_table_t *tableptr;
+
+	application_index_length = 0;
+
+	for(tableptr = application_function_table; tableptr->function; tableptr++)
+	{
+		application_index_add(tableptr->command1, tableptr - application_function_table);
+
+		if(strcmp(tableptr->command1, tableptr->command2))
+			application_index_add(tableptr->command2, tableptr - application_function_table);
+	}
+}
+
+irom static const application_function_table_t *application_function_lookup(const string_t *command)
+{
+	int low, high, mid;
+
+	if(application_index_length == 0)
+		application_init();
+
+	low = 0;
+	high = application_index_length;
+
+	// find the first entry that's not less than the command
+
+	while(low < high)
+	{
+		mid = (low + high) / 2;
+
+		if(application_index_compare(application_index[mid].name, application_index[mid].length,
+					string_buffer(command), string_length(command)) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if((low < application_index_length) &&
+			!application_index_compare(application_index[low].name, application_index[low].length,
+				string_buffer(command), string_length(command)))
+		return(&application_function_table[application_index[low].entry]);
+
+	return((const application_function_table_t *)0);
+}
+
+/*
+ * Every command run is timed, from the lookup in application_content() to
+ * its return, plus the time for the later chunks of its output. The reply
+ * size is the length of one reply or chunk. The totals stop at their
+ * maximum instead of wrapping, that's over an hour of run time.
+ */
+
+typedef struct
+{
+	uint32_t	count;
+	uint32_t	time_total_us;
+	uint32_t	time_max_us;
+	uint32_t	reply_total;
+	uint32_t	reply_max;
+} application_profile_t;
+
+always_inline static void application_profile_sum(uint32_t *total, uint32_t value)
+{
+	if((*total + value) < *total)
+		*total = ~(uint32_t)0;
+	else
+		*total += value;
+}
+
+static application_profile_t application_profile[sizeof(application_function_table) / sizeof(*application_function_table)];
+
+irom static void application_profile_add(const application_function_table_t *tableptr, bool_t invocation, uint32_t time_us, int length)
+{
+	application_profile_t *profile = &application_profile[tableptr - application_function_table];
+
+	if(invocation)
+		profile->count++;
+
+	application_profile_sum(&profile->time_total_us, time_us);
+
+	if(profile->time_max_us < time_us)
+		profile->time_max_us = time_us;
+
+	application_profile_sum(&profile->reply_total, length);
+
+	if(profile->reply_max < (uint32_t)length)
+		profile->reply_max = length;
+}
+
+irom static void application_profile_reset(void)
+{
+	memset(application_profile, 0, sizeof(application_profile));
+}
+
+irom static bool_t application_profile_generator(string_t *dst, app_generator_state_t *state)
+{
+	const application_function_table_t *tableptr;
+	const application_profile_t *profile;
+	int mark;
+
+	for(tableptr = &application_function_table[state->cursor]; tableptr->function; tableptr++, state->cursor++)
+	{
+		profile = &application_profile[state->cursor];
+
+		if(profile->count == 0)
+			continue;
+
+		mark = string_length(dst);
+
+		string_format(dst, "> %-20s runs: %5u, time avg: %7u us, max: %7u us, total: %7u ms, reply avg: %4u, max: %4u\n",
+				tableptr->command2,
+				profile->count,
+				(unsigned int)(profile->time_total_us / profile->count),
+				profile->time_max_us,
+				(unsigned int)(profile->time_total_us / 1000),
+				(unsigned int)(profile->reply_total / profile->count),
+				profile->reply_max);
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+	}
+
+	return(true);
+}
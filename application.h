@@ -12,9 +12,31 @@ typedef enum
 	app_action_reset,
 	app_action_ota_commit,
 	app_action_http_ok,
+	app_action_more,
 } app_action_t;
 
 _Static_assert(sizeof(app_action_t) == 4, "sizeof(app_action_t) != 4");
 
+/*
+ * A command with more output than fits in one packet hands a generator to
+ * application_generate(). It's called for every chunk, appends as much as
+ * fits and returns true when the output is complete; the command returns
+ * app_action_more until then and the next chunk is made with
+ * application_continue() after the previous one has been sent.
+ */
+
+typedef struct
+{
+	unsigned int	cursor;
+	int				parameter[2];
+} app_generator_state_t;
+
+typedef bool_t app_generator_t(string_t *dst, app_generator_state_t *state);
+
+void application_init(void);
 app_action_t application_content(const string_t *src, string_t *dst);
+app_action_t application_generate(string_t *dst, app_generator_t *generator, int parameter0, int parameter1);
+app_action_t application_continue(string_t *dst);
+bool_t application_generating(void);
+void application_generate_cancel(void);
 #endif
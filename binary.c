@@ -0,0 +1,193 @@
+#include "binary.h"
+#include "io.h"
+#include "i2c_sensor.h"
+
+#include <stdint.h>
+
+always_inline static unsigned int get_u8(const string_t *src, int offset)
+{
+	return((uint8_t)string_at(src, offset));
+}
+
+always_inline static unsigned int get_u16(const string_t *src, int offset)
+{
+	return(get_u8(src, offset + 0) << 0 |
+			get_u8(src, offset + 1) << 8);
+}
+
+always_inline static uint32_t get_u32(const string_t *src, int offset)
+{
+	return((uint32_t)get_u8(src, offset + 0) << 0 |
+			(uint32_t)get_u8(src, offset + 1) << 8 |
+			(uint32_t)get_u8(src, offset + 2) << 16 |
+			(uint32_t)get_u8(src, offset + 3) << 24);
+}
+
+always_inline static void put_u8(string_t *dst, unsigned int value)
+{
+	string_append_char(dst, (char)(value & 0xff));
+}
+
+always_inline static void put_u16(string_t *dst, unsigned int value)
+{
+	put_u8(dst, value >> 0);
+	put_u8(dst, value >> 8);
+}
+
+always_inline static void put_u32(string_t *dst, uint32_t value)
+{
+	put_u8(dst, value >> 0);
+	put_u8(dst, value >> 8);
+	put_u8(dst, value >> 16);
+	put_u8(dst, value >> 24);
+}
+
+// handlers get the payload's offset and length, the reply status has
+// already been written, they only append the rest of the reply payload
+
+typedef binary_status_t binary_handler_t(const string_t *src, int offset, int length, string_t *dst);
+
+irom static binary_status_t binary_nop(const string_t *src, int offset, int length, string_t *dst)
+{
+	return(binary_status_ok);
+}
+
+irom static binary_status_t binary_io_read(const string_t *src, int offset, int length, string_t *dst)
+{
+	string_new(stack, error, 64);
+	int value;
+
+	if(length < 2)
+		return(binary_status_length);
+
+	if(io_read_pin(&error, get_u8(src, offset + 0), get_u8(src, offset + 1), &value) != io_ok)
+		return(binary_status_error);
+
+	put_u32(dst, (uint32_t)value);
+
+	return(binary_status_ok);
+}
+
+irom static binary_status_t binary_io_write(const string_t *src, int offset, int length, string_t *dst)
+{
+	string_new(stack, error, 64);
+
+	if(length < 6)
+		return(binary_status_length);
+
+	if(io_write_pin(&error, get_u8(src, offset + 0), get_u8(src, offset + 1), (int)get_u32(src, offset + 2)) != io_ok)
+		return(binary_status_error);
+
+	return(binary_status_ok);
+}
+
+irom static binary_status_t binary_io_trigger(const string_t *src, int offset, int length, string_t *dst)
+{
+	string_new(stack, error, 64);
+	unsigned int trigger;
+
+	if(length < 3)
+		return(binary_status_length);
+
+	if(((trigger = get_u8(src, offset + 2)) == io_trigger_none) || (trigger >= io_trigger_size))
+		return(binary_status_error);
+
+	if(io_trigger_pin(&error, get_u8(src, offset + 0), get_u8(src, offset + 1), (io_trigger_t)trigger) != io_ok)
+		return(binary_status_error);
+
+	return(binary_status_ok);
+}
+
+irom static binary_status_t binary_sensor_read(const string_t *src, int offset, int length, string_t *dst)
+{
+	unsigned int sensor;
+	double value;
+
+	if(length < 2)
+		return(binary_status_length);
+
+	if((sensor = get_u8(src, offset + 1)) >= i2c_sensor_size)
+		return(binary_status_error);
+
+	if(i2c_sensor_read_value(get_u8(src, offset + 0), (i2c_sensor_t)sensor, &value) != i2c_error_ok)
+		return(binary_status_error);
+
+	put_u32(dst, (uint32_t)(int)((value * 1000) + ((value < 0) ? -0.5 : 0.5)));
+
+	return(binary_status_ok);
+}
+
+static binary_handler_t * const binary_handler[] =
+{
+	[binary_op_nop] =			binary_nop,
+	[binary_op_io_read] =		binary_io_read,
+	[binary_op_io_write] =		binary_io_write,
+	[binary_op_io_trigger] =	binary_io_trigger,
+	[binary_op_sensor_read] =	binary_sensor_read,
+};
+
+/*
+ * Each frame gets a reply frame with the same sequence number, also for
+ * frames with a bad crc or an unknown opcode. A truncated frame ends the
+ * packet, there is no way to find the next frame after it.
+ */
+
+irom app_action_t binary_content(const string_t *src, string_t *dst)
+{
+	unsigned int version, opcode, sequence, length;
+	binary_status_t status;
+	int offset, reply, payload;
+	char *buffer;
+
+	for(offset = 0; (string_length(src) - offset) >= (binary_header_size + binary_crc_size); offset += binary_header_size + length + binary_crc_size)
+	{
+		if((get_u8(src, offset + 0) != binary_magic_0) || (get_u8(src, offset + 1) != binary_magic_1))
+			break;
+
+		if((string_size(dst) - string_length(dst)) < 32)
+			break;
+
+		version = get_u8(src, offset + 2);
+		opcode = get_u8(src, offset + 3);
+		sequence = get_u16(src, offset + 4);
+		length = get_u16(src, offset + 6);
+
+		reply = string_length(dst);
+
+		put_u8(dst, binary_magic_0);
+		put_u8(dst, binary_magic_1);
+		put_u8(dst, binary_version);
+		put_u8(dst, opcode | binary_reply);
+		put_u16(dst, sequence);
+		put_u16(dst, 0);
+
+		payload = string_length(dst);
+		put_u8(dst, binary_status_ok);
+
+		if((offset + binary_header_size + (int)length + binary_crc_size) > string_length(src))
+			status = binary_status_length;
+		else if(get_u32(src, offset + binary_header_size + length) != string_crc32(src, offset, binary_header_size + length))
+			status = binary_status_crc;
+		else if(version != binary_version)
+			status = binary_status_version;
+		else if((opcode >= (sizeof(binary_handler) / sizeof(*binary_handler))) || !binary_handler[opcode])
+			status = binary_status_opcode;
+		else
+			status = binary_handler[opcode](src, offset + binary_header_size, length, dst);
+
+		if(status != binary_status_ok)
+			string_setlength(dst, payload + 1);
+
+		buffer = string_buffer_nonconst(dst);
+		buffer[payload] = status;
+		buffer[reply + 6] = ((string_length(dst) - payload) >> 0) & 0xff;
+		buffer[reply + 7] = ((string_length(dst) - payload) >> 8) & 0xff;
+
+		put_u32(dst, string_crc32(dst, reply, string_length(dst) - reply));
+
+		if(status == binary_status_length)
+			break;
+	}
+
+	return(app_action_normal);
+}
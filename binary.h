@@ -0,0 +1,64 @@
+#ifndef binary_h
+#define binary_h
+
+#include "util.h"
+#include "application.h"
+
+/*
+ * Binary command frames, all fields little endian:
+ *
+ * 0	magic			2 bytes, 0xa5 0x5a
+ * 2	version			1 byte, 1
+ * 3	opcode			1 byte, replies have bit 7 set
+ * 4	sequence		2 bytes, copied into the reply
+ * 6	payload length	2 bytes
+ * 8	payload
+ * 8+n	crc32			4 bytes, over header and payload
+ *
+ * A packet may contain any number of frames, each one gets a reply frame.
+ * The first payload byte of a reply is a binary_status_t.
+ *
+ * The crc is the non-reflected crc32 (polynomial 0x04c11db7, initial value
+ * and final xor 0xffffffff, "CRC-32/BZIP2"), not the reflected one zlib
+ * uses. It's transmitted little endian like the other fields.
+ */
+
+enum
+{
+	binary_magic_0 = 0xa5,
+	binary_magic_1 = 0x5a,
+	binary_version = 1,
+	binary_header_size = 8,
+	binary_crc_size = 4,
+	binary_reply = 0x80,
+};
+
+typedef enum
+{
+	binary_op_nop = 0x00,			// -> status
+	binary_op_io_read = 0x01,		// io u8, pin u8 -> status, value s32
+	binary_op_io_write = 0x02,		// io u8, pin u8, value s32 -> status
+	binary_op_io_trigger = 0x03,	// io u8, pin u8, trigger u8 -> status
+	binary_op_sensor_read = 0x04,	// bus u8, sensor u8 -> status, value s32 in 1/1000 units
+} binary_opcode_t;
+
+typedef enum
+{
+	binary_status_ok = 0,
+	binary_status_error,
+	binary_status_crc,
+	binary_status_length,
+	binary_status_version,
+	binary_status_opcode,
+} binary_status_t;
+
+always_inline static bool_t binary_is_frame(const string_t *src)
+{
+	return((string_length(src) >= (binary_header_size + binary_crc_size)) &&
+			((uint8_t)string_at(src, 0) == binary_magic_0) &&
+			((uint8_t)string_at(src, 1) == binary_magic_1));
+}
+
+app_action_t binary_content(const string_t *src, string_t *dst);
+
+#endif
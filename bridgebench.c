@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+/*
+ * Benchmark for the uart bridge. Connect to the bridge port and stream
+ * numbered frames to it, at a chosen rate. The device's uart must have
+ * tx and rx connected (loopback), so everything that's sent comes back.
+ * The received stream is scanned for frames, which are checked and used
+ * to calculate throughput, loss, reordering and round trip time.
+ *
+ * With --loopback a local echo server is started and used instead of
+ * a device, to check the tool itself and the host's network stack.
+ */
+
+enum
+{
+	frame_magic = 0x42424e43,
+	frame_header_size = 4 + 4 + 8 + 2,
+	frame_size_min = frame_header_size + 2,
+	frame_size_max = 1024,
+	histogram_buckets = 12,
+	receive_buffer_size = 65536,
+};
+
+typedef enum
+{
+	false = 0,
+	true = 1,
+} bool;
+
+typedef struct
+{
+	uint32_t	magic;
+	uint32_t	sequence;
+	uint64_t	timestamp;
+	uint16_t	length;
+} frame_header_t;
+
+static unsigned int verbose, udp, timeout;
+
+static struct
+{
+	uint64_t		bytes_sent;
+	uint64_t		bytes_received;
+	unsigned int	frames_sent;
+	unsigned int	frames_received;
+	unsigned int	frames_corrupt;
+	unsigned int	frames_duplicate;
+	unsigned int	frames_reordered;
+	unsigned int	bytes_skipped;
+	uint64_t		rtt_total;
+	uint64_t		rtt_min;
+	uint64_t		rtt_max;
+	unsigned int	histogram[histogram_buckets];
+} stats;
+
+static uint8_t *seen;
+static unsigned int seen_size;
+static int highest_sequence = -1;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: bridgebench [options] <host>\n");
+	fprintf(stderr, "-d|--duration s      run for this many seconds (default 10)\n");
+	fprintf(stderr, "-f|--frame-size n    size of each frame in bytes (%d - %d, default 64)\n", frame_size_min, frame_size_max);
+	fprintf(stderr, "-l|--loopback        start a local echo server and use it instead of a device (host can be omitted)\n");
+	fprintf(stderr, "-p|--port            set bridge port (default 23)\n");
+	fprintf(stderr, "-r|--rate bytes/s    send rate (default 0 = as fast as possible)\n");
+	fprintf(stderr, "-t|--timeout ms      time to wait for outstanding frames after sending (default = 2000 = 2s)\n");
+	fprintf(stderr, "-u|--udp             use udp instead of tcp\n");
+	fprintf(stderr, "-v|--verbose         verbose\n");
+}
+
+static uint64_t now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+
+	return(((uint64_t)tv.tv_sec * 1000000) + (uint64_t)tv.tv_usec);
+}
+
+static int resolve(const char * hostname, int port, struct sockaddr_in6 *saddr)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char service[16];
+	int s;
+
+	snprintf(service, sizeof(service), "%u", port);
+	memset(&hints, 0, sizeof(hints));
+
+	hints.ai_family		=	AF_INET6;
+	hints.ai_socktype	=	udp ? SOCK_DGRAM : SOCK_STREAM;
+	hints.ai_flags		=	AI_NUMERICSERV | AI_V4MAPPED;
+
+	if((s = getaddrinfo(hostname, service, &hints, &res)))
+		return(0);
+
+	*saddr = *(struct sockaddr_in6 *)(void *)res->ai_addr;
+	freeaddrinfo(res);
+
+	return(1);
+}
+
+static void put_le(uint8_t *dst, uint64_t value, int length)
+{
+	int ix;
+
+	for(ix = 0; ix < length; ix++)
+		dst[ix] = (value >> (ix * 8)) & 0xff;
+}
+
+static uint64_t get_le(const uint8_t *src, int length)
+{
+	uint64_t value;
+	int ix;
+
+	for(value = 0, ix = length - 1; ix >= 0; ix--)
+		value = (value << 8) | src[ix];
+
+	return(value);
+}
+
+static uint8_t pattern(unsigned int sequence, unsigned int offset)
+{
+	return((sequence * 7 + offset) & 0xff);
+}
+
+static void frame_build(uint8_t *dst, unsigned int sequence, unsigned int size)
+{
+	unsigned int ix;
+
+	put_le(dst + 0, frame_magic, 4);
+	put_le(dst + 4, sequence, 4);
+	put_le(dst + 8, now_us(), 8);
+	put_le(dst + 16, size, 2);
+
+	for(ix = frame_header_size; ix < size; ix++)
+		dst[ix] = pattern(sequence, ix);
+}
+
+static void frame_header_parse(const uint8_t *src, frame_header_t *header)
+{
+	header->magic		= get_le(src + 0, 4);
+	header->sequence	= get_le(src + 4, 4);
+	header->timestamp	= get_le(src + 8, 8);
+	header->length		= get_le(src + 16, 2);
+}
+
+// returns false for a corrupt frame
+
+static bool frame_received(const uint8_t *src, const frame_header_t *header, uint64_t received)
+{
+	unsigned int ix, bucket;
+	uint64_t rtt;
+
+	for(ix = frame_header_size; ix < header->length; ix++)
+	{
+		if(src[ix] != pattern(header->sequence, ix))
+		{
+			if(verbose)
+				fprintf(stderr, "* frame %u corrupt at offset %u\n", header->sequence, ix);
+
+			stats.frames_corrupt++;
+			return(false);
+		}
+	}
+
+	if((header->sequence >= seen_size) || seen[header->sequence])
+	{
+		stats.frames_duplicate++;
+		return(true);
+	}
+
+	seen[header->sequence] = 1;
+
+	if((int)header->sequence < highest_sequence)
+		stats.frames_reordered++;
+	else
+		highest_sequence = header->sequence;
+
+	rtt = received - header->timestamp;
+
+	stats.frames_received++;
+	stats.rtt_total += rtt;
+
+	if((stats.rtt_min == 0) || (rtt < stats.rtt_min))
+		stats.rtt_min = rtt;
+
+	if(rtt > stats.rtt_max)
+		stats.rtt_max = rtt;
+
+	bucket = 0;
+
+	while((bucket < (histogram_buckets - 1)) && (rtt >= ((uint64_t)1000 << bucket)))
+		bucket++;
+
+	stats.histogram[bucket]++;
+
+	return(true);
+}
+
+// scan the received data for complete frames, return the number of bytes
+// consumed; after a corrupt frame scanning resumes right after its magic, as
+// the frame may have been cut short by lost data and the next one may
+// start within it
+
+static unsigned int frames_scan(const uint8_t *src, unsigned int length, uint64_t received)
+{
+	frame_header_t header;
+	unsigned int offset;
+
+	offset = 0;
+
+	while((length - offset) >= frame_header_size)
+	{
+		frame_header_parse(src + offset, &header);
+
+		if((header.magic != frame_magic) || (header.length < frame_size_min) || (header.length > frame_size_max))
+		{
+			offset++;
+			stats.bytes_skipped++;
+			continue;
+		}
+
+		if((length - offset) < header.length)
+			break;
+
+		if(frame_received(src + offset, &header, received))
+			offset += header.length;
+		else
+			offset++;
+	}
+
+	return(offset);
+}
+
+static void echo_server(int listen_fd)
+{
+	char buffer[4096];
+	struct sockaddr_in6 saddr;
+	socklen_t saddr_length;
+	ssize_t length;
+	int fd;
+
+	if(udp)
+	{
+		for(;;)
+		{
+			saddr_length = sizeof(saddr);
+
+			if((length = recvfrom(listen_fd, buffer, sizeof(buffer), 0, (struct sockaddr *)(void *)&saddr, &saddr_length)) < 0)
+				exit(1);
+
+			sendto(listen_fd, buffer, length, 0, (const struct sockaddr *)(const void *)&saddr, saddr_length);
+		}
+	}
+
+	if((fd = accept(listen_fd, 0, 0)) < 0)
+		exit(1);
+
+	while((length = read(fd, buffer, sizeof(buffer))) > 0)
+		if(write(fd, buffer, length) != length)
+			break;
+
+	exit(0);
+}
+
+static pid_t echo_server_start(int port)
+{
+	struct sockaddr_in6 saddr;
+	int fd, one = 1;
+	pid_t pid;
+
+	if((fd = socket(AF_INET6, udp ? SOCK_DGRAM : SOCK_STREAM, 0)) < 0)
+	{
+		fprintf(stderr, "echo server: socket failed: %m\n");
+		return(-1);
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin6_family = AF_INET6;
+	saddr.sin6_port = htons(port);
+	saddr.sin6_addr = in6addr_loopback;
+
+	if(bind(fd, (const struct sockaddr *)(const void *)&saddr, sizeof(saddr)))
+	{
+		fprintf(stderr, "echo server: bind failed: %m\n");
+		close(fd);
+		return(-1);
+	}
+
+	if(!udp && listen(fd, 1))
+	{
+		fprintf(stderr, "echo server: listen failed: %m\n");
+		close(fd);
+		return(-1);
+	}
+
+	if((pid = fork()) < 0)
+	{
+		fprintf(stderr, "echo server: fork failed: %m\n");
+		close(fd);
+		return(-1);
+	}
+
+	if(pid == 0)
+		echo_server(fd);
+
+	close(fd);
+
+	return(pid);
+}
+
+static void report(uint64_t elapsed)
+{
+	static const char *bucket_name[histogram_buckets] =
+	{
+		"< 1 ms", "< 2 ms", "< 4 ms", "< 8 ms", "< 16 ms", "< 32 ms", "< 64 ms",
+		"< 128 ms", "< 256 ms", "< 512 ms", "< 1024 ms", ">= 1024 ms",
+	};
+
+	unsigned int bucket, lost;
+	double seconds;
+
+	seconds = (double)elapsed / 1000000;
+	lost = stats.frames_sent - stats.frames_received;
+
+	printf("duration:        %.3f s\n", seconds);
+	printf("sent:            %u frames, %" PRIu64 " bytes, %.0f bytes/s\n",
+			stats.frames_sent, stats.bytes_sent, (double)stats.bytes_sent / seconds);
+	printf("received:        %u frames, %" PRIu64 " bytes, %.0f bytes/s\n",
+			stats.frames_received, stats.bytes_received, (double)stats.bytes_received / seconds);
+	printf("lost:            %u frames (%.2f %%)\n", lost, stats.frames_sent ? (100.0 * lost) / stats.frames_sent : 0);
+	printf("corrupt:         %u frames\n", stats.frames_corrupt);
+	printf("duplicate:       %u frames\n", stats.frames_duplicate);
+	printf("reordered:       %u frames\n", stats.frames_reordered);
+	printf("skipped:         %u bytes\n", stats.bytes_skipped);
+
+	if(stats.frames_received > 0)
+		printf("round trip time: min %.3f ms, avg %.3f ms, max %.3f ms\n",
+				(double)stats.rtt_min / 1000,
+				(double)stats.rtt_total / stats.frames_received / 1000,
+				(double)stats.rtt_max / 1000);
+
+	for(bucket = 0; bucket < histogram_buckets; bucket++)
+		if(stats.histogram[bucket] > 0)
+			printf("  %-10s %8u %6.2f %%\n", bucket_name[bucket], stats.histogram[bucket],
+					(100.0 * stats.histogram[bucket]) / stats.frames_received);
+}
+
+int main(int argc, char *const *argv)
+{
+	static const char *shortopts = "d:f:lp:r:t:uv";
+	static const struct option longopts[] =
+	{
+		{ "duration",	required_argument,	0, 'd' },
+		{ "frame-size",	required_argument,	0, 'f' },
+		{ "loopback",	no_argument,		0, 'l' },
+		{ "port",		required_argument,	0, 'p' },
+		{ "rate",		required_argument,	0, 'r' },
+		{ "timeout",	required_argument,	0, 't' },
+		{ "udp",		no_argument,		0, 'u' },
+		{ "verbose",	no_argument,		0, 'v' },
+		{ 0, 0, 0, 0 }
+	};
+
+	static uint8_t		receive_buffer[receive_buffer_size];
+	uint8_t				frame[frame_size_max];
+	struct sockaddr_in6	saddr;
+	struct pollfd		pfd;
+	const char			*hostname;
+	unsigned int		duration = 10, frame_size = 64, rate = 0;
+	unsigned int		received_length, consumed;
+	uint64_t			start, now, deadline, last_received;
+	ssize_t				length;
+	int					arg, socket_fd;
+	int					port = 23;
+	bool				loopback = false;
+	pid_t				echo_pid = -1;
+
+	timeout = 2000;
+	verbose = 0;
+	udp = 0;
+
+	while((arg = getopt_long(argc, argv, shortopts, longopts, 0)) != -1)
+	{
+		switch(arg)
+		{
+			case('d'):
+			{
+				duration = atoi(optarg);
+				break;
+			}
+
+			case('f'):
+			{
+				frame_size = atoi(optarg);
+				break;
+			}
+
+			case('l'):
+			{
+				loopback = true;
+				break;
+			}
+
+			case('p'):
+			{
+				port = atoi(optarg);
+				break;
+			}
+
+			case('r'):
+			{
+				rate = atoi(optarg);
+				break;
+			}
+
+			case('t'):
+			{
+				timeout = atoi(optarg);
+				break;
+			}
+
+			case('u'):
+			{
+				udp = 1;
+				break;
+			}
+
+			case('v'):
+			{
+				verbose = 1;
+				break;
+			}
+
+			default:
+			{
+				usage();
+				exit(1);
+			}
+		}
+	}
+
+	if((frame_size < frame_size_min) || (frame_size > frame_size_max))
+	{
+		fprintf(stderr, "frame size must be between %d and %d bytes\n", frame_size_min, frame_size_max);
+		exit(1);
+	}
+
+	if(loopback)
+	{
+		hostname = "::1";
+
+		if((echo_pid = echo_server_start(port)) < 0)
+			exit(1);
+	}
+	else
+	{
+		if((argc - optind) < 1)
+		{
+			usage();
+			exit(1);
+		}
+
+		hostname = argv[optind];
+	}
+
+	// worst case: the line is saturated with minimum size frames for the whole run
+
+	seen_size = ((rate ? rate : 10000000) / frame_size_min + 1) * (duration + 1);
+
+	if(!(seen = calloc(seen_size, 1)))
+	{
+		fprintf(stderr, "out of memory\n");
+		goto error;
+	}
+
+	if(!resolve(hostname, port, &saddr))
+	{
+		fprintf(stderr, "cannot resolve hostname %s\n", hostname);
+		goto error;
+	}
+
+	if((socket_fd = socket(AF_INET6, udp ? SOCK_DGRAM : SOCK_STREAM, 0)) < 0)
+	{
+		fprintf(stderr, "socket failed: %m\n");
+		goto error;
+	}
+
+	if(!udp)
+	{
+		arg = 1;
+		setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &arg, sizeof(arg));
+	}
+
+	if(connect(socket_fd, (const struct sockaddr *)(const void *)&saddr, sizeof(saddr)))
+	{
+		fprintf(stderr, "connect failed: %m\n");
+		goto error;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	received_length = 0;
+
+	start = now_us();
+	deadline = start + ((uint64_t)duration * 1000000);
+	last_received = start;
+
+	for(;;)
+	{
+		now = now_us();
+
+		if(now >= deadline)
+		{
+			if((stats.frames_received + stats.frames_corrupt) >= stats.frames_sent)
+				break;
+
+			if((now - last_received) >= ((uint64_t)timeout * 1000))
+				break;
+		}
+
+		pfd.fd = socket_fd;
+		pfd.events = POLLIN;
+
+		if((now < deadline) && (stats.frames_sent < seen_size) &&
+				((rate == 0) || ((stats.bytes_sent * 1000000) < ((now - start) * rate))))
+			pfd.events |= POLLOUT;
+
+		if(poll(&pfd, 1, (pfd.events & POLLOUT) ? 100 : 1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+
+			fprintf(stderr, "poll failed: %m\n");
+			goto error;
+		}
+
+		if(pfd.revents & POLLIN)
+		{
+			if((length = read(socket_fd, receive_buffer + received_length, sizeof(receive_buffer) - received_length)) <= 0)
+			{
+				fprintf(stderr, "connection closed by peer\n");
+				break;
+			}
+
+			now = now_us();
+			last_received = now;
+			stats.bytes_received += length;
+			received_length += length;
+
+			consumed = frames_scan(receive_buffer, received_length, now);
+
+			// the bridge cuts the uart stream into datagrams anywhere, so
+			// frames span datagrams with udp too
+
+			memmove(receive_buffer, receive_buffer + consumed, received_length - consumed);
+			received_length -= consumed;
+		}
+
+		if(pfd.revents & POLLOUT)
+		{
+			frame_build(frame, stats.frames_sent, frame_size);
+
+			if((length = write(socket_fd, frame, frame_size)) != (ssize_t)frame_size)
+			{
+				if((length < 0) && ((errno == EAGAIN) || (errno == ENOBUFS)))
+					continue;
+
+				fprintf(stderr, "write failed: %m\n");
+				goto error;
+			}
+
+			stats.frames_sent++;
+			stats.bytes_sent += frame_size;
+		}
+	}
+
+	close(socket_fd);
+
+	report(now_us() - start);
+
+	if(echo_pid > 0)
+	{
+		kill(echo_pid, SIGTERM);
+		waitpid(echo_pid, 0, 0);
+	}
+
+	free(seen);
+
+	return(0);
+
+error:
+	if(echo_pid > 0)
+	{
+		kill(echo_pid, SIGTERM);
+		waitpid(echo_pid, 0, 0);
+	}
+
+	free(seen);
+
+	return(1);
+}
@@ -9,15 +9,22 @@
 #include <c_types.h>
 #include <spi_flash.h>
 
+// the text format is still read, it's converted on the next config write
+
 #define CONFIG_MAGIC "%4afc0002%"
 
 enum
 {
 	config_entries_size = 100,
-	config_entry_id_size = 28,
-	config_entry_string_size = 32
+	config_entry_id_size = config_key_size,
+	config_entry_string_size = 32,
+	config_index_size = 256,
 };
 
+_Static_assert((config_index_size & (config_index_size - 1)) == 0, "config_index_size must be a power of two");
+_Static_assert(config_index_size > (2 * config_entries_size), "config_index_size too small");
+_Static_assert(config_entries_size < 256, "config index entries are 8 bits");
+
 typedef struct
 {
 	char	id[config_entry_id_size];
@@ -27,15 +34,75 @@ typedef struct
 
 assert_size(config_entry_t, 64);
 
+/*
+ * Binary format: a header, then for each entry the length of the id and
+ * of the string value (one byte each), the int value (four bytes, little
+ * endian, already parsed) and the id and value without terminating
+ * zeroes. The crc covers the records.
+ */
+
+enum
+{
+	config_binary_magic = 0x32434641, // "AFC2"
+	config_binary_version = 1,
+	config_binary_record_header_size = 6,
+};
+
+typedef struct
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	entries;
+	uint32_t	length;
+	uint32_t	crc;
+} config_binary_header_t;
+
+assert_size(config_binary_header_t, 16);
+
 config_options_t config_options =
 {
 	.using_logbuffer = 0
 };
 
 config_flags_t flags_cache;
+
+// bumped on every change, so cached values know when to look again
+
+unsigned int config_generation = 1;
+unsigned int config_cache_generation = 0;
+int config_cache[config_id_size];
+
+typedef struct
+{
+	const char		*key;
+	config_type_t	type;
+	int				int_default;
+	const char		*string_default;
+} config_registry_entry_t;
+
+#define config_registry_strings(_name, _key, _type, _int_default, _string_default) \
+	static roflash const char config_key_ ## _name[] = _key; \
+	static roflash const char config_default_ ## _name[] = _string_default;
+config_registry(config_registry_strings)
+#undef config_registry_strings
+
+static roflash const config_registry_entry_t config_registry_table[config_id_size] =
+{
+#define config_registry_entry(_name, _key, _type, _int_default, _string_default) \
+	[config_id_ ## _name] = { config_key_ ## _name, _type, _int_default, config_default_ ## _name },
+	config_registry(config_registry_entry)
+#undef config_registry_entry
+};
+
 static unsigned int config_entries_length = 0;
 static config_entry_t config_entries[config_entries_size];
 
+// open addressing hash table on the config ids, each slot holds an index
+// into config_entries plus one, zero is a free slot; deleted entries are
+// taken out by rebuilding it
+
+static uint8_t config_index[config_index_size];
+
 irom static bool_t config_flags_set(config_flags_t flags)
 {
 	string_init(varname, "flags");
@@ -93,6 +160,16 @@ irom void config_flags_to_string(string_t *dst)
 		string_append(dst, " log-to-buffer");
 	else
 		string_append(dst, " no-log-to-buffer");
+
+	if(flags.flag.uart_flow_control)
+		string_append(dst, " uart-flow-control");
+	else
+		string_append(dst, " no-uart-flow-control");
+
+	if(flags.flag.log_to_uart1)
+		string_append(dst, " log-to-uart1");
+	else
+		string_append(dst, " no-log-to-uart1");
 }
 
 irom bool_t config_flags_change(const string_t *flag, bool_t add)
@@ -154,6 +231,18 @@ irom bool_t config_flags_change(const string_t *flag, bool_t add)
 		rv = true;
 	}
 
+	if(string_match_cstr(flag, "uart-flow-control") || string_match_cstr(flag, "ufc"))
+	{
+		flags.flag.uart_flow_control = add ? 1 : 0;
+		rv = true;
+	}
+
+	if(string_match_cstr(flag, "log-to-uart1") || string_match_cstr(flag, "lu1"))
+	{
+		flags.flag.log_to_uart1 = add ? 1 : 0;
+		rv = true;
+	}
+
 	if(rv)
 		rv = config_flags_set(flags);
 
@@ -167,39 +256,158 @@ typedef enum
 	state_parse_eol,
 } state_parse_t;
 
-irom static string_t *expand_varid(const string_t *varid, int index1, int index2)
+// FNV-1a
+
+always_inline static uint32_t config_hash(const char *id, int length)
 {
-	string_new(static, varid_in, 64);
-	string_new(static, varid_out, 64);
+	uint32_t hash = 2166136261U;
 
-	string_clear(&varid_in);
-	string_clear(&varid_out);
+	while(length-- > 0)
+	{
+		hash ^= (uint8_t)*id++;
+		hash *= 16777619U;
+	}
 
-	string_append_string(&varid_in, varid);
-	string_format_cstr(&varid_out, string_to_cstr(&varid_in), index1, index2);
+	return(hash);
+}
 
-	return(&varid_out);
+irom static void config_index_insert(unsigned int entry)
+{
+	const char *id = config_entries[entry].id;
+	unsigned int slot;
+
+	for(slot = config_hash(id, strlen(id)) & (config_index_size - 1); config_index[slot]; slot = (slot + 1) & (config_index_size - 1))
+		(void)0;
+
+	config_index[slot] = entry + 1;
 }
 
-irom static config_entry_t *find_config_entry(const string_t *id, int index1, int index2)
+irom static void config_index_rebuild(void)
 {
-	config_entry_t *config_entry;
-	const string_t *varid;
 	unsigned int ix;
 
-	varid = expand_varid(id, index1, index2);
+	memset(config_index, 0, sizeof(config_index));
 
 	for(ix = 0; ix < config_entries_length; ix++)
+		if(config_entries[ix].id[0])
+			config_index_insert(ix);
+}
+
+irom static config_entry_t *config_index_find(const char *id, int length, uint32_t hash)
+{
+	config_entry_t *config_entry;
+	unsigned int slot;
+
+	if(length >= config_entry_id_size)
+		return((config_entry_t *)0);
+
+	for(slot = hash & (config_index_size - 1); config_index[slot]; slot = (slot + 1) & (config_index_size - 1))
 	{
-		config_entry = &config_entries[ix];
+		config_entry = &config_entries[config_index[slot] - 1];
 
-		if(string_match_cstr(varid, config_entry->id))
+		if(!memcmp(config_entry->id, id, length) && (config_entry->id[length] == '\0'))
 			return(config_entry);
 	}
 
 	return((config_entry_t *)0);
 }
 
+always_inline static void expand_number(string_t *dst, unsigned int value)
+{
+	char digits[10];
+	int length = 0;
+
+	do
+		digits[length++] = '0' + (value % 10);
+	while((value /= 10) > 0);
+
+	while(length > 0)
+		string_append_char(dst, digits[--length]);
+}
+
+// Ids only use %u and %d, they're expanded here without printf. Anything
+// else is left to string_format_cstr().
+
+irom static void expand_id(string_t *dst, const string_t *id, int index1, int index2)
+{
+	string_new(stack, id_cstr, 64);
+	int ix, argument, current;
+
+	string_clear(dst);
+
+	for(ix = 0, argument = 0; ix < string_length(id); ix++)
+	{
+		current = string_at(id, ix);
+
+		if(current != '%')
+		{
+			string_append_char(dst, current);
+			continue;
+		}
+
+		switch(string_at(id, ++ix))
+		{
+			case('%'):
+			{
+				string_append_char(dst, '%');
+				break;
+			}
+
+			case('d'):
+			{
+				current = argument++ ? index2 : index1;
+
+				if(current < 0)
+				{
+					string_append_char(dst, '-');
+					expand_number(dst, 0U - (unsigned int)current);
+				}
+				else
+					expand_number(dst, current);
+
+				break;
+			}
+
+			case('u'):
+			{
+				expand_number(dst, argument++ ? index2 : index1);
+				break;
+			}
+
+			default:
+			{
+				string_clear(dst);
+				string_append_string(&id_cstr, id);
+				string_format_cstr(dst, string_to_cstr(&id_cstr), index1, index2);
+				return;
+			}
+		}
+	}
+
+	if(string_length(dst) >= string_size(dst))
+		string_setlength(dst, string_size(dst) - 1);
+
+	string_buffer_nonconst(dst)[string_length(dst)] = '\0';
+}
+
+irom static string_t *expand_varid(const string_t *varid, int index1, int index2)
+{
+	string_new(static, varid_out, 64);
+
+	expand_id(&varid_out, varid, index1, index2);
+
+	return(&varid_out);
+}
+
+irom static config_entry_t *find_config_entry(const string_t *id, int index1, int index2)
+{
+	const string_t *varid;
+
+	varid = expand_varid(id, index1, index2);
+
+	return(config_index_find(string_buffer(varid), string_length(varid), config_hash(string_buffer(varid), string_length(varid))));
+}
+
 irom bool_t config_get_string(const string_t *id, int index1, int index2, string_t *value)
 {
 	config_entry_t *config_entry;
@@ -268,7 +476,8 @@ irom bool_t config_set_string(const string_t *id, int index1, int index2, const
 		}
 
 		varid = expand_varid(id, index1, index2);
-		strecpy(config_current->id, string_to_cstr(varid), config_entry_string_size);
+		strecpy(config_current->id, string_to_cstr(varid), config_entry_id_size);
+		config_index_insert(config_current - config_entries);
 	}
 
 	strecpy(config_current->string_value, string_buffer(value) + value_offset, value_length + 1);
@@ -278,6 +487,8 @@ irom bool_t config_set_string(const string_t *id, int index1, int index2, const
 	if(parse_int(0, &string, &config_current->int_value, 0, ' ') != parse_ok)
 		config_current->int_value = -1;
 
+	config_generation++;
+
 	return(true);
 }
 
@@ -314,9 +525,157 @@ irom unsigned int config_delete(const string_t *id, int index1, int index2, bool
 		}
 	}
 
+	if(amount > 0)
+	{
+		config_index_rebuild();
+		config_generation++;
+	}
+
 	return(amount);
 }
 
+irom static void config_registry_key(config_id_t id, string_t *key)
+{
+	string_clear(key);
+	string_append_cstr_flash(key, config_registry_table[id].key);
+}
+
+irom void config_cache_refresh(void)
+{
+	string_new(stack, key, config_key_size);
+	config_entry_t *config_entry;
+	unsigned int id;
+
+	for(id = 0; id < config_id_size; id++)
+	{
+		if(config_registry_table[id].type != config_type_int)
+			continue;
+
+		config_registry_key(id, &key);
+
+		if((config_entry = config_index_find(string_buffer(&key), string_length(&key), config_hash(string_buffer(&key), string_length(&key)))))
+			config_cache[id] = config_entry->int_value;
+		else
+			config_cache[id] = config_registry_table[id].int_default;
+	}
+
+	config_cache_generation = config_generation;
+}
+
+irom int config_int_default(config_id_t id)
+{
+	return(config_registry_table[id].int_default);
+}
+
+// a value equal to the default isn't stored
+
+irom bool_t config_set_int_id(config_id_t id, int value)
+{
+	string_new(stack, key, config_key_size);
+
+	config_registry_key(id, &key);
+
+	if(value == config_registry_table[id].int_default)
+	{
+		config_delete(&key, -1, -1, false);
+		return(true);
+	}
+
+	return(config_set_int(&key, -1, -1, value));
+}
+
+irom bool_t config_set_string_id(config_id_t id, const string_t *value)
+{
+	string_new(stack, key, config_key_size);
+	string_new(stack, string_default, config_entry_string_size);
+
+	config_registry_key(id, &key);
+	string_append_cstr_flash(&string_default, config_registry_table[id].string_default);
+
+	if(string_match_string(value, &string_default))
+	{
+		config_delete(&key, -1, -1, false);
+		return(true);
+	}
+
+	return(config_set_string(&key, -1, -1, value, -1, -1));
+}
+
+irom void config_get_string_id(config_id_t id, string_t *value)
+{
+	string_new(stack, key, config_key_size);
+
+	config_registry_key(id, &key);
+
+	if(!config_get_string(&key, -1, -1, value))
+		string_append_cstr_flash(value, config_registry_table[id].string_default);
+}
+
+irom static bool_t config_read_binary(const string_t *src)
+{
+	config_binary_header_t header;
+	config_entry_t *entry;
+	const uint8_t *record;
+	unsigned int offset, id_length, value_length;
+
+	memcpy(&header, string_buffer(src), sizeof(header));
+
+	if((header.magic != config_binary_magic) || (header.version != config_binary_version) ||
+			(header.entries > config_entries_size) || (header.length > (string_length(src) - sizeof(header))))
+		return(false);
+
+	string_crc32_init();
+
+	if(string_crc32(src, sizeof(header), header.length) != header.crc)
+		return(false);
+
+	config_entries_length = 0;
+
+	for(offset = sizeof(header); config_entries_length < header.entries; config_entries_length++)
+	{
+		if((offset + config_binary_record_header_size) > (sizeof(header) + header.length))
+			break;
+
+		record = (const uint8_t *)string_buffer(src) + offset;
+		id_length = record[0];
+		value_length = record[1];
+
+		if((id_length >= config_entry_id_size) || (value_length >= config_entry_string_size) ||
+				((offset + config_binary_record_header_size + id_length + value_length) > (sizeof(header) + header.length)))
+			break;
+
+		entry = &config_entries[config_entries_length];
+
+		entry->int_value = (int)((uint32_t)record[2] << 0 | (uint32_t)record[3] << 8 | (uint32_t)record[4] << 16 | (uint32_t)record[5] << 24);
+		memcpy(entry->id, record + config_binary_record_header_size, id_length);
+		entry->id[id_length] = '\0';
+		memcpy(entry->string_value, record + config_binary_record_header_size + id_length, value_length);
+		entry->string_value[value_length] = '\0';
+
+		offset += config_binary_record_header_size + id_length + value_length;
+	}
+
+	config_index_rebuild();
+	config_generation++;
+
+	return(true);
+}
+
+// uart.data has been renamed to uart.bits, a config saved by an older
+// firmware still has the old key
+
+irom static void config_migrate(void)
+{
+	int value;
+	string_init(varname_uart_data, "uart.data");
+
+	if(config_get_int(&varname_uart_data, -1, -1, &value))
+	{
+		config_set_int_id(config_id_uart_bits, value);
+		config_delete(&varname_uart_data, -1, -1, false);
+	}
+}
+
 irom bool_t config_read(void)
 {
 	string_new(stack, string, 64);
@@ -336,6 +695,12 @@ irom bool_t config_read(void)
 
 	string_setlength(&logbuffer, SPI_FLASH_SEC_SIZE);
 
+	if(config_read_binary(&logbuffer))
+	{
+		rv = true;
+		goto done;
+	}
+
 	string_append(&string, CONFIG_MAGIC);
 	string_append(&string, "\n");
 
@@ -350,6 +715,8 @@ irom bool_t config_read(void)
 	value_length = 0;
 
 	config_entries_length = 0;
+	config_index_rebuild();
+	config_generation++;
 
 	for(parse_state = state_parse_id; current_index < SPI_FLASH_SEC_SIZE; current_index++)
 	{
@@ -431,6 +798,8 @@ done:
 	string_clear(&logbuffer);
 	config_options.using_logbuffer = 0;
 
+	config_migrate();
+
 	string_init(varname, "flags");
 
 	if(!config_get_int(&varname, -1, -1, &flags_cache.intval))
@@ -446,8 +815,9 @@ done:
 
 irom unsigned int config_write(void)
 {
+	config_binary_header_t header;
 	config_entry_t *entry;
-	unsigned int ix, length = 0;
+	unsigned int ix, length = 0, id_length, value_length;
 	uint32_t crc1, crc2;
 	bool_t rv = false;
 
@@ -458,8 +828,11 @@ irom unsigned int config_write(void)
 		goto error;
 
 	string_clear(&logbuffer);
-	string_append(&logbuffer, CONFIG_MAGIC);
-	string_append(&logbuffer, "\n");
+	string_setlength(&logbuffer, sizeof(header));
+
+	header.magic = config_binary_magic;
+	header.version = config_binary_version;
+	header.entries = 0;
 
 	for(ix = 0; ix < config_entries_length; ix++)
 	{
@@ -468,20 +841,35 @@ irom unsigned int config_write(void)
 		if(!entry->id[0])
 			continue;
 
-		string_format(&logbuffer, "%s=%s\n", entry->id, entry->string_value);
-	}
+		id_length = strlen(entry->id);
+		value_length = strlen(entry->string_value);
 
-	string_append(&logbuffer, "\n");
+		if((string_length(&logbuffer) + config_binary_record_header_size + id_length + value_length) > SPI_FLASH_SEC_SIZE)
+			goto error;
 
-	length = string_length(&logbuffer);
+		string_append_char(&logbuffer, (char)id_length);
+		string_append_char(&logbuffer, (char)value_length);
+		string_append_char(&logbuffer, (char)((entry->int_value >> 0) & 0xff));
+		string_append_char(&logbuffer, (char)((entry->int_value >> 8) & 0xff));
+		string_append_char(&logbuffer, (char)((entry->int_value >> 16) & 0xff));
+		string_append_char(&logbuffer, (char)((entry->int_value >> 24) & 0xff));
+		memcpy(string_buffer_nonconst(&logbuffer) + string_length(&logbuffer), entry->id, id_length);
+		memcpy(string_buffer_nonconst(&logbuffer) + string_length(&logbuffer) + id_length, entry->string_value, value_length);
+		string_setlength(&logbuffer, string_length(&logbuffer) + id_length + value_length);
 
-	if(length > (4096 - 32))
-		goto error;
+		header.entries++;
+	}
 
-	while(string_length(&logbuffer) < SPI_FLASH_SEC_SIZE)
-		string_append_char(&logbuffer, '.');
+	length = string_length(&logbuffer);
 
 	string_crc32_init();
+	header.length = length - sizeof(header);
+	header.crc = string_crc32(&logbuffer, sizeof(header), header.length);
+	memcpy(string_buffer_nonconst(&logbuffer), &header, sizeof(header));
+
+	memset(string_buffer_nonconst(&logbuffer) + length, 0xff, SPI_FLASH_SEC_SIZE - length);
+	string_setlength(&logbuffer, SPI_FLASH_SEC_SIZE);
+
 	crc1 = string_crc32(&logbuffer, 0, SPI_FLASH_SEC_SIZE);
 
 	if(spi_flash_erase_sector(USER_CONFIG_SECTOR) != SPI_FLASH_RESULT_OK)
@@ -509,22 +897,65 @@ error:
 	return(rv ? length : 0);
 }
 
-irom void config_dump(string_t *dst)
+// *cursor is the next slot to dump, then the summary and then the
+// registered keys with their defaults; returns true when the dump is complete
+
+irom bool_t config_dump(string_t *dst, unsigned int *cursor)
 {
+	string_new(stack, key, config_key_size);
 	config_entry_t *config_current;
 	unsigned int ix, in_use = 0;
+	int mark;
 
-	for(ix = 0; ix < config_entries_length; ix++)
+	for(; *cursor < config_entries_length; (*cursor)++)
 	{
-		config_current = &config_entries[ix];
+		config_current = &config_entries[*cursor];
 
 		if(!config_current->id[0])
 			continue;
 
-		in_use++;
+		mark = string_length(dst);
 
 		string_format(dst, "%s=%s (%d)\n", config_current->id, config_current->string_value, config_current->int_value);
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
 	}
 
-	string_format(dst, "\nslots total: %u, config items: %u, free slots: %u\n", config_entries_size, in_use, config_entries_size - in_use);
-}
+	if(*cursor == config_entries_length)
+	{
+		for(ix = 0; ix < config_entries_length; ix++)
+			if(config_entries[ix].id[0])
+				in_use++;
+
+		mark = string_length(dst);
+
+		string_format(dst, "\nslots total: %u, config items: %u, free slots: %u\n\ndefaults:\n", config_entries_size, in_use, config_entries_size - in_use);
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+
+		(*cursor)++;
+	}
+
+	for(ix = *cursor - (config_entries_length + 1); ix < config_id_size; ix++, (*cursor)++)
+	{
+		mark = string_length(dst);
+
+		config_registry_key(ix, &key);
+		string_append_string(dst, &key);
+		string_append(dst, "=");
+
+		if(config_registry_table[ix].type == config_type_int)
+			string_format(dst, "%d", config_registry_table[ix].int_default);
+		else
+			string_append_cstr_flash(dst, config_registry_table[ix].string_default);
+
+		string_append(dst, "\n");
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+	}
+
+	return(true);
+}
\ No newline at end of file
@@ -25,6 +25,8 @@ typedef union
 		unsigned int enable_cfa634:1;
 		unsigned int i2c_high_speed:1;
 		unsigned int log_to_buffer:1;
+		unsigned int uart_flow_control:1;
+		unsigned int log_to_uart1:1;
 	} flag;
 
 	uint32_t intval;
@@ -35,6 +37,72 @@ typedef struct
 	unsigned int using_logbuffer:1;
 } config_options_t;
 
+enum
+{
+	config_key_size = 28,
+};
+
+typedef enum
+{
+	config_type_int,
+	config_type_string,
+} config_type_t;
+
+/*
+ * Registry of the plain (not indexed) config keys with their type and
+ * default. Every entry gets an id config_id_<name>; the int values are
+ * cached and can be read with config_int() without any lookup, the text
+ * store stays where they're kept.
+ */
+
+#define config_registry(entry) \
+	entry(uart_baud,				"uart.baud",				config_type_int,	115200,						"") \
+	entry(uart_bits,				"uart.bits",				config_type_int,	8,							"") \
+	entry(uart_stop,				"uart.stop",				config_type_int,	1,							"") \
+	entry(uart_parity,				"uart.parity",				config_type_int,	parity_none,				"") \
+	entry(uart_rx_full,				"uart.rxfull",				config_type_int,	0,							"") \
+	entry(uart_rx_timeout,			"uart.rxtimeout",			config_type_int,	0,							"") \
+	entry(uart_tx_empty,			"uart.txempty",				config_type_int,	0,							"") \
+	entry(bridge_port,				"bridge.port",				config_type_int,	0,							"") \
+	entry(bridge_timeout,			"bridge.timeout",			config_type_int,	90,							"") \
+	entry(bridge_coalesce_bytes,	"bridge.coalesce.bytes",	config_type_int,	0,							"") \
+	entry(bridge_coalesce_time,		"bridge.coalesce.time",		config_type_int,	0,							"") \
+	entry(bridge_framing_mode,		"bridge.framing.mode",		config_type_int,	0,							"") \
+	entry(bridge_framing_gap,		"bridge.framing.gap",		config_type_int,	4,							"") \
+	entry(bridge_framing_delimiter,	"bridge.framing.delimiter",	config_type_int,	'\n',						"") \
+	entry(bridge_clients,			"bridge.clients",			config_type_int,	1,							"") \
+	entry(bridge_writers,			"bridge.writers",			config_type_int,	0,							"") \
+	entry(bridge_writer_ip_0,		"bridge.writer.ip.0",		config_type_int,	0,							"") \
+	entry(bridge_writer_ip_1,		"bridge.writer.ip.1",		config_type_int,	0,							"") \
+	entry(bridge_writer_ip_2,		"bridge.writer.ip.2",		config_type_int,	0,							"") \
+	entry(bridge_writer_ip_3,		"bridge.writer.ip.3",		config_type_int,	0,							"") \
+	entry(cmd_port,					"cmd.port",					config_type_int,	24,							"") \
+	entry(cmd_timeout,				"cmd.timeout",				config_type_int,	90,							"") \
+	entry(cmd_backlog,				"cmd.backlog",				config_type_int,	4,							"") \
+	entry(wlan_mode,				"wlan.mode",				config_type_int,	config_wlan_mode_client,	"") \
+	entry(wlan_client_ssid,			"wlan.client.ssid",			config_type_string,	0,							"esp") \
+	entry(wlan_client_passwd,		"wlan.client.passwd",		config_type_string,	0,							"espespesp") \
+	entry(wlan_ap_ssid,				"wlan.ap.ssid",				config_type_string,	0,							"esp") \
+	entry(wlan_ap_passwd,			"wlan.ap.passwd",			config_type_string,	0,							"espespesp") \
+	entry(wlan_ap_channel,			"wlan.ap.channel",			config_type_int,	1,							"") \
+	entry(pwm_period,				"pwm.period",				config_type_int,	65536,						"") \
+	entry(display_fliptimeout,		"display.fliptimeout",		config_type_int,	4,							"") \
+	entry(ntp_tz,					"ntp.tz",					config_type_int,	0,							"") \
+	entry(trigger_status_io,		"trigger.status.io",		config_type_int,	-1,							"") \
+	entry(trigger_status_pin,		"trigger.status.pin",		config_type_int,	-1,							"") \
+	entry(trigger_assoc_io,			"trigger.assoc.io",			config_type_int,	-1,							"") \
+	entry(trigger_assoc_pin,		"trigger.assoc.pin",		config_type_int,	-1,							"")
+
+typedef enum
+{
+#define config_registry_id(_name, _key, _type, _int_default, _string_default) config_id_ ## _name,
+	config_registry(config_registry_id)
+#undef config_registry_id
+	config_id_size,
+} config_id_t;
+
+_Static_assert(config_id_bridge_writer_ip_3 == (config_id_bridge_writer_ip_0 + 3), "bridge.writer.ip entries must be consecutive");
+
 void			config_flags_to_string(string_t *);
 bool_t			config_flags_change(const string_t *, bool_t add);
 
@@ -46,16 +114,35 @@ unsigned int	config_delete(const string_t *id, int index1, int index2, bool_t wi
 
 bool_t			config_read(void);
 unsigned int	config_write(void);
-void			config_dump(string_t *);
+bool_t			config_dump(string_t *, unsigned int *cursor);
+
+void			config_cache_refresh(void);
+int				config_int_default(config_id_t id);
+bool_t			config_set_int_id(config_id_t id, int value);
+bool_t			config_set_string_id(config_id_t id, const string_t *value);
+void			config_get_string_id(config_id_t id, string_t *value);
 
 extern config_flags_t flags_cache;
 extern config_options_t config_options;
+extern unsigned int config_generation;
+extern unsigned int config_cache_generation;
+extern int config_cache[config_id_size];
 
 always_inline static config_flags_t config_flags_get(void)
 {
 	return(flags_cache);
 }
 
+// the cached values are looked up again only after the config has changed
+
+always_inline static int config_int(config_id_t id)
+{
+	if(config_cache_generation != config_generation)
+		config_cache_refresh();
+
+	return(config_cache[id]);
+}
+
 always_inline static attr_pure bool_t config_uses_logbuffer(void)
 {
 	return(config_options.using_logbuffer != 0);
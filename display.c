@@ -427,7 +427,6 @@ irom bool display_periodic(void) // gets called 10 times per second
 	static int expire_counter = 0;
 	int now, flip_timeout;
 	display_info_t *display_info_entry;
-	string_init(varname_fliptimeout, "display.fliptimeout");
 
 	if(display_data.detected < 0)
 		return(false);
@@ -441,8 +440,7 @@ irom bool display_periodic(void) // gets called 10 times per second
 		expire_counter = 0;
 		display_expire();
 
-		if(!config_get_int(&varname_fliptimeout, 0, 0, &flip_timeout))
-			flip_timeout = 4;
+		flip_timeout = config_int(config_id_display_fliptimeout);
 
 		if((last_update > now) || ((last_update + flip_timeout) < now))
 		{
@@ -546,7 +544,6 @@ irom app_action_t application_function_display_default_message(const string_t *s
 irom app_action_t application_function_display_flip_timeout(const string_t *src, string_t *dst)
 {
 	int timeout;
-	string_init(varname_fliptimeout, "display.fliptimeout");
 
 	if(parse_int(1, src, &timeout, 0, ' ') == parse_ok)
 	{
@@ -556,18 +553,14 @@ irom app_action_t application_function_display_flip_timeout(const string_t *src,
 			return(app_action_error);
 		}
 
-		if(timeout == 4)
-			config_delete(&varname_fliptimeout, -1, -1, false);
-		else
-			if(!config_set_int(&varname_fliptimeout, -1, -1, timeout))
-			{
-				string_append(dst, "> cannot set config\n");
-				return(app_action_error);
-			}
+		if(!config_set_int_id(config_id_display_fliptimeout, timeout))
+		{
+			string_append(dst, "> cannot set config\n");
+			return(app_action_error);
+		}
 	}
 
-	if(!config_get_int(&varname_fliptimeout, -1, -1, &timeout))
-		timeout = 4;
+	timeout = config_int(config_id_display_fliptimeout);
 
 	string_format(dst, "> timeout: %u s\n", timeout);
 
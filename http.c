@@ -12,6 +12,7 @@ typedef struct
 	const char *description;
 	const char *action;
 	app_action_t (*handler)(const string_t *src, string_t *dst);
+	bool_t (*generator)(string_t *dst, unsigned int *cursor);
 } http_handler_t;
 
 static const http_handler_t handlers[];
@@ -30,7 +31,6 @@ roflash static const char roflash_http_header_ok[] =
 {
 	"200 OK\r\n"
 	"Content-Type: text/html; charset=UTF-8\r\n"
-	"Content-Length: @@@@\r\n"
 	"Connection: close\r\n"
 	"\r\n"
 };
@@ -112,12 +112,10 @@ irom static void http_range_form(string_t *dst, int io, int pin, int low, int hi
 {
 	int pwm_period;
 	string_new(stack, id, 32);
-	string_init(varname_pwmperiod, "pwm.period");
 
 	string_format(&id, "range_%d_%d", io, pin);
 
-	if(!config_get_int(&varname_pwmperiod, -1, -1, &pwm_period))
-		pwm_period = 65536;
+	pwm_period = config_int(config_id_pwm_period);
 
 	string_format(dst,	"<form id=\"form_%s\" class=\"form\" method=\"get\" action=\"%s\">\n", string_to_cstr(&id), "set");
 	string_append(dst,		"	<div class=\"div\">\n");
@@ -168,12 +166,40 @@ irom static app_action_t http_error(string_t *dst, const char *error_string, con
 	return(app_action_error);
 }
 
+/*
+ * A page is sent in chunks, the http header, the html header and the output
+ * of the handler go in the first one, the output of the page's generator, if
+ * any, follows in as many chunks as needed and the footer goes last. The
+ * length isn't known up front, so there is no Content-Length, the end of the
+ * page is marked by closing the connection.
+ */
+
+irom static bool_t http_page_generator(string_t *dst, app_generator_state_t *state)
+{
+	const http_handler_t *handler = &handlers[state->parameter[0]];
+	int mark;
+
+	if(!state->parameter[1])
+	{
+		if(handler->generator && !handler->generator(dst, &state->cursor))
+			return(false);
+
+		state->parameter[1] = 1;
+	}
+
+	mark = string_length(dst);
+
+	string_append_cstr_flash(dst, roflash_html_link_home);
+	string_append_cstr_flash(dst, roflash_html_footer);
+
+	return(string_chunk_fits(dst, mark));
+}
+
 irom app_action_t application_function_http_get(const string_t *src, string_t *dst)
 {
 	string_new(, url, 64);
 	string_new(, afterslash, 64);
 	string_new(, action, 64);
-	int ix, length;
 	const http_handler_t *handler;
 	app_action_t error;
 
@@ -192,11 +218,11 @@ irom app_action_t application_function_http_get(const string_t *src, string_t *d
 		string_append_string(&action, &afterslash);
 	}
 
-	for(handler = &handlers[0]; handler->action && handler->handler; handler++)
+	for(handler = &handlers[0]; handler->action; handler++)
 		if(string_match_cstr(&action, handler->action))
 			break;
 
-	if(!handler->action || !handler->handler)
+	if(!handler->action)
 		return(http_error(dst, "404 Not Found", string_to_cstr(&action)));
 
 	string_clear(dst);
@@ -204,24 +230,12 @@ irom app_action_t application_function_http_get(const string_t *src, string_t *d
 	string_append_cstr_flash(dst, roflash_http_header_ok);
 	string_append_cstr_flash(dst, roflash_html_header);
 
-	error = handler->handler(&afterslash, dst);
-
-	string_append_cstr_flash(dst, roflash_html_link_home);
-	string_append_cstr_flash(dst, roflash_html_footer);
-
-	if((length = string_length(dst) - (sizeof(roflash_http_header_pre) - 1) - (sizeof(roflash_http_header_ok) - 1)) <= 0)
-		return(http_error(dst, "500 Internal Server Error", 0));
+	error = app_action_http_ok;
 
-	if((ix = string_find(dst, 0, '@')) <= 0)
-		return(http_error(dst, "501 Not Implemented", 0));
+	if(handler->handler)
+		error = handler->handler(&afterslash, dst);
 
-	string_replace(dst, ix + 0, (length / 1000) + '0');
-	length %= 1000;
-	string_replace(dst, ix + 1, (length / 100) + '0');
-	length %= 100;
-	string_replace(dst, ix + 2, (length / 10) + '0');
-	length %= 10;
-	string_replace(dst, ix + 3, (length / 1) + '0');
+	application_generate(dst, http_page_generator, handler - &handlers[0], 0);
 
 	return(error);
 }
@@ -233,7 +247,7 @@ irom static app_action_t handler_root(const string_t *src, string_t *dst)
 	string_append_cstr_flash(dst, roflash_html_table_start);
 	string_append(dst, "<tr><th colspan=\"2\">ESP8266 Universal I/O bridge</th></tr>\n");
 
-	for(handler = &handlers[0]; handler->action && handler->handler; handler++)
+	for(handler = &handlers[0]; handler->action; handler++)
 		if(handler->description)
 			string_format(dst, "<tr><td>%s</td><td><a href=\"/%s\">/%s</a></td></tr>\n", handler->description, handler->action, handler->action);
 
@@ -242,19 +256,29 @@ irom static app_action_t handler_root(const string_t *src, string_t *dst)
 	return(app_action_http_ok);
 }
 
-irom static app_action_t handler_controls(const string_t *src, string_t *dst)
+irom static bool_t generator_controls(string_t *dst, unsigned int *cursor)
 {
-	int				io, pin;
+	int				ix, io, pin, mark;
 	int				low, high, step, current;
 	io_pin_mode_t	mode;
 
-	for(io = 0; io < io_id_size; io++)
-		for(pin = 0; pin < max_pins_per_io; pin++)
-			if(io_traits(0, io, pin, &mode, &low, &high, &step, &current) == io_ok)
-				if(high > 0)
-					http_range_form(dst, io, pin, low, high, step, current);
+	for(ix = *cursor; ix < (io_id_size * max_pins_per_io); ix++, *cursor = ix)
+	{
+		io = ix / max_pins_per_io;
+		pin = ix % max_pins_per_io;
 
-	return(app_action_http_ok);
+		if((io_traits(0, io, pin, &mode, &low, &high, &step, &current) != io_ok) || (high <= 0))
+			continue;
+
+		mark = string_length(dst);
+
+		http_range_form(dst, io, pin, low, high, step, current);
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+	}
+
+	return(true);
 }
 
 irom static app_action_t handler_set(const string_t *src, string_t *dst)
@@ -377,38 +401,63 @@ irom static app_action_t handler_info_wlan(const string_t *src, string_t *dst)
 	return(app_action_http_ok);
 }
 
-irom static app_action_t handler_io(const string_t *src, string_t *dst)
+irom static bool_t generator_io(string_t *dst, unsigned int *cursor)
 {
-	io_config_dump(dst, -1, -1, true);
-
-	return(app_action_http_ok);
+	return(io_config_dump(dst, -1, -1, true, cursor));
 }
 
-irom static app_action_t handler_sensors(const string_t *src, string_t *dst)
+// cursor 0 is the table header, then one for every bus/sensor combination
+
+irom static bool_t generator_sensors(string_t *dst, unsigned int *cursor)
 {
 	i2c_sensor_t sensor;
-	int bus;
+	int ix, bus, mark;
 	int detected = 0;
 
-	string_append_cstr_flash(dst, roflash_html_table_start);
-	string_append(dst, "<tr><th>bus</th><th>sensor</th><th>address</th><th>name</th><th>type</th><th>value</th></tr>\n");
+	if(*cursor == 0)
+	{
+		mark = string_length(dst);
+
+		string_append_cstr_flash(dst, roflash_html_table_start);
+		string_append(dst, "<tr><th>bus</th><th>sensor</th><th>address</th><th>name</th><th>type</th><th>value</th></tr>\n");
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+
+		*cursor = 1;
+	}
+
+	for(ix = *cursor - 1; ix < (i2c_busses * i2c_sensor_size); ix++, *cursor = ix + 1)
+	{
+		bus = ix / i2c_sensor_size;
+		sensor = ix % i2c_sensor_size;
+
+		if(!i2c_sensor_detected(bus, sensor))
+			continue;
+
+		mark = string_length(dst);
+
+		string_append(dst, "<tr><td>");
+		i2c_sensor_read(dst, bus, sensor, false, true);
+		string_append(dst, "</td></tr>\n");
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+	}
+
+	mark = string_length(dst);
 
 	for(bus = 0; bus < i2c_busses; bus++)
 		for(sensor = 0; sensor < i2c_sensor_size; sensor++)
 			if(i2c_sensor_detected(bus, sensor))
-			{
-				string_append(dst, "<tr><td>");
-				i2c_sensor_read(dst, bus, sensor, false, true);
-				string_append(dst, "</td></tr>\n");
 				detected++;
-			}
 
 	if(detected < 1)
 		string_append(dst, "<tr><td colspan=\"6\">no sensors detected</td></tr>\n");
 
 	string_append_cstr_flash(dst, roflash_html_table_end);
 
-	return(app_action_http_ok);
+	return(string_chunk_fits(dst, mark));
 }
 
 irom static app_action_t handler_resetwlanscreen(const string_t *src, string_t *dst)
@@ -431,9 +480,6 @@ irom static app_action_t handler_resetwlan(const string_t *src, string_t *dst)
 	string_new(stack, param2, 32);
 	string_new(stack, ssid, 32);
 	string_new(stack, passwd, 32);
-	string_init(varname_wlan_client_ssid, "wlan.client.ssid");
-	string_init(varname_wlan_client_passwd, "wlan.client.passwd");
-	string_init(varname_wlan_mode, "wlan.mode");
 
 	if(parse_string(1, src, &getparam, '?') != parse_ok)
 		goto parameter_error;
@@ -459,13 +505,13 @@ irom static app_action_t handler_resetwlan(const string_t *src, string_t *dst)
 	if((string_length(&ssid) < 4) || (string_length(&passwd) < 8))
 		goto parameter_error;
 
-	if(!config_set_string(&varname_wlan_client_ssid, -1, -1, &ssid, -1, -1))
+	if(!config_set_string_id(config_id_wlan_client_ssid, &ssid))
 		goto config_error;
 
-	if(!config_set_string(&varname_wlan_client_passwd, -1, -1, &passwd, -1, -1))
+	if(!config_set_string_id(config_id_wlan_client_passwd, &passwd))
 		goto config_error;
 
-	if(!config_set_int(&varname_wlan_mode, -1, -1, config_wlan_mode_client))
+	if(!config_set_int_id(config_id_wlan_mode, config_wlan_mode_client))
 		goto config_error;
 
 	if(config_write() == 0)
@@ -499,76 +545,91 @@ static const http_handler_t handlers[] =
 	{
 		"Home",
 		"",
-		handler_root
+		handler_root,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Information about the firmware",
 		"info_fw",
-		handler_info_fw
+		handler_info_fw,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Information about the i2c bus",
 		"info_i2c",
-		handler_info_i2c
+		handler_info_i2c,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Information about time keeping",
 		"info_time",
-		handler_info_time
+		handler_info_time,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Information about WLAN",
 		"info_wlan",
-		handler_info_wlan
+		handler_info_wlan,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Statistics",
 		"info_stats",
-		handler_info_stats
+		handler_info_stats,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"List all I/O's",
 		"io",
-		handler_io
+		(app_action_t (*)(const string_t *, string_t *))0,
+		generator_io
 	},
 	{
 		"Control outputs",
 		"controls",
-		handler_controls
+		(app_action_t (*)(const string_t *, string_t *))0,
+		generator_controls
 	},
 	{
 		"List all sensors",
 		"sensors",
-		handler_sensors,
+		(app_action_t (*)(const string_t *, string_t *))0,
+		generator_sensors
 	},
 	{
 		"Set an I/O",
 		"set",
-		handler_set
+		handler_set,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Reset WLAN configuration",
 		"resetwlanscreen",
 		handler_resetwlanscreen,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		(const char *)0,
 		"resetwlan",
-		handler_resetwlan
+		handler_resetwlan,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		"Reset",
 		"reset",
-		handler_reset
+		handler_reset,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		(const char *)0,
 		"favicon.ico",
-		handler_favicon
+		handler_favicon,
+		(bool_t (*)(string_t *, unsigned int *))0
 	},
 	{
 		(const char *)0,
 		(const char *)0,
-		(app_action_t (*)(const string_t *, string_t *))0
+		(app_action_t (*)(const string_t *, string_t *))0,
+		(bool_t (*)(string_t *, unsigned int *))0
 	}
 };
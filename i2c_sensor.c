@@ -3302,6 +3302,62 @@ irom void i2c_sensor_init_all(void)
 				i2c_sensor_init(bus, current);
 }
 
+/*
+ * Factor and offset are configured in thousandths. They're looked up on
+ * every sensor read, so the last few are kept, indexed by sensor; an entry
+ * is valid until the config changes.
+ */
+
+enum
+{
+	i2c_sensor_calibration_cache_size = 4,
+};
+
+typedef struct
+{
+	unsigned int	generation;
+	uint8_t			valid;
+	uint8_t			bus;
+	i2c_sensor_t	sensor;
+	int				factor;
+	int				offset;
+} i2c_sensor_calibration_t;
+
+static i2c_sensor_calibration_t i2c_sensor_calibration_cache[i2c_sensor_calibration_cache_size];
+
+irom static void i2c_sensor_calibration(int bus, i2c_sensor_t sensor, int *factor, int *offset)
+{
+	i2c_sensor_calibration_t *cache = &i2c_sensor_calibration_cache[sensor % i2c_sensor_calibration_cache_size];
+	string_init(varname_i2s_factor, "i2s.%u.%u.factor");
+	string_init(varname_i2s_offset, "i2s.%u.%u.offset");
+
+	if(!cache->valid || (cache->generation != config_generation) || (cache->bus != bus) || (cache->sensor != sensor))
+	{
+		if(!config_get_int(&varname_i2s_factor, bus, sensor, &cache->factor))
+			cache->factor = 1000;
+
+		if(!config_get_int(&varname_i2s_offset, bus, sensor, &cache->offset))
+			cache->offset = 0;
+
+		cache->valid = 1;
+		cache->generation = config_generation;
+		cache->bus = bus;
+		cache->sensor = sensor;
+	}
+
+	*factor = cache->factor;
+	*offset = cache->offset;
+}
+
+irom static void i2c_sensor_calibrate(int bus, i2c_sensor_t sensor, double *value)
+{
+	int int_factor, int_offset;
+
+	i2c_sensor_calibration(bus, sensor, &int_factor, &int_offset);
+
+	*value = (*value * int_factor / 1000.0) + (int_offset / 1000.0);
+}
+
 irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t verbose, bool_t html)
 {
 	const device_table_entry_t *entry;
@@ -3310,8 +3366,6 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 	int current;
 	int int_factor, int_offset;
 	double extracooked;
-	string_init(varname_i2s_factor, "i2s.%u.%u.factor");
-	string_init(varname_i2s_offset, "i2s.%u.%u.offset");
 
 	for(current = 0; current < i2c_sensor_size; current++)
 	{
@@ -3344,13 +3398,8 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 
 	if((error = entry->read_fn(bus, entry, &value)) == i2c_error_ok)
 	{
-		if(!config_get_int(&varname_i2s_factor, bus, sensor, &int_factor))
-			int_factor = 1000;
-
-		if(!config_get_int(&varname_i2s_offset, bus, sensor, &int_offset))
-			int_offset = 0;
-
-		extracooked = (value.cooked * int_factor / 1000.0) + (int_offset / 1000.0);
+		extracooked = value.cooked;
+		i2c_sensor_calibrate(bus, sensor, &extracooked);
 
 		if(html)
 		{
@@ -3389,11 +3438,7 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 
 	if(verbose)
 	{
-		if(!config_get_int(&varname_i2s_factor, bus, sensor, &int_factor))
-			int_factor = 1000;
-
-		if(!config_get_int(&varname_i2s_offset, bus, sensor, &int_offset))
-			int_offset = 0;
+		i2c_sensor_calibration(bus, sensor, &int_factor, &int_offset);
 
 		string_append(dst, ", calibration: factor=");
 		string_double(dst, int_factor / 1000.0, 4, 1e10);
@@ -3405,6 +3450,42 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 	return(true);
 }
 
+// read a sensor without formatting, the value is calibrated with the configured factor and offset
+
+irom i2c_error_t i2c_sensor_read_value(int bus, i2c_sensor_t sensor, double *dst)
+{
+	const device_table_entry_t *entry;
+	i2c_error_t error;
+	value_t value;
+	int current;
+
+	for(current = 0; current < i2c_sensor_size; current++)
+	{
+		entry = &device_table[current];
+
+		if(sensor == entry->id)
+			break;
+	}
+
+	if(current >= i2c_sensor_size)
+		return(i2c_error_error);
+
+	if((error = i2c_select_bus(bus)) != i2c_error_ok)
+	{
+		i2c_select_bus(0);
+		return(error);
+	}
+
+	if((error = entry->read_fn(bus, entry, &value)) == i2c_error_ok)
+	{
+		*dst = value.cooked;
+		i2c_sensor_calibrate(bus, sensor, dst);
+	}
+
+	i2c_select_bus(0);
+	return(error);
+}
+
 irom attr_pure bool_t i2c_sensor_detected(int bus, i2c_sensor_t sensor)
 {
 	if(sensor > i2c_sensor_size)
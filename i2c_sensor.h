@@ -58,6 +58,7 @@ assert_size(i2c_sensor_t, 1);
 i2c_error_t	i2c_sensor_init(int bus, i2c_sensor_t);
 void		i2c_sensor_init_all(void);
 bool_t		i2c_sensor_read(string_t *, int bus, i2c_sensor_t, bool_t verbose, bool_t html);
+i2c_error_t	i2c_sensor_read_value(int bus, i2c_sensor_t, double *value);
 bool_t		i2c_sensor_detected(int bus, i2c_sensor_t);
 
 #endif
@@ -932,10 +932,8 @@ irom io_error_t io_traits(string_t *errormsg, int io, int pin, io_pin_mode_t *pi
 	io_config_pin_entry_t *pin_config;
 	io_data_pin_entry_t *pin_data;
 	int pwm_period;
-	string_init(varname_pwmperiod, "pwm.period");
 
-	if(!config_get_int(&varname_pwmperiod, -1, -1, &pwm_period))
-		pwm_period = 65536;
+	pwm_period = config_int(config_id_pwm_period);
 
 	if(io >= io_id_size)
 	{
@@ -1337,12 +1335,9 @@ attr_speed iram void io_periodic(void)
 	io_config_pin_entry_t *pin_config;
 	io_data_pin_entry_t *pin_data;
 	int io, pin;
-	int trigger_status_io, trigger_status_pin;
 	io_flags_t flags = { .counter_triggered = 0 };
 	int value;
 	int trigger;
-	string_init(varname_trigger_io, "trigger.status.io");
-	string_init(varname_trigger_pin, "trigger.status.pin");
 
 	for(io = 0; io < io_id_size; io++)
 	{
@@ -1447,17 +1442,17 @@ attr_speed iram void io_periodic(void)
 		}
 	}
 
-	if(flags.counter_triggered &&
-			config_get_int(&varname_trigger_io, -1, -1, &trigger_status_io) &&
-			config_get_int(&varname_trigger_pin, -1, -1, &trigger_status_pin) &&
-			(trigger_status_io >= 0) && (trigger_status_pin >= 0))
-	{
-		io_trigger_pin((string_t *)0, trigger_status_io, trigger_status_pin, io_trigger_on);
-	}
+	if(flags.counter_triggered && (config_int(config_id_trigger_status_io) >= 0) && (config_int(config_id_trigger_status_pin) >= 0))
+		io_trigger_pin((string_t *)0, config_int(config_id_trigger_status_io), config_int(config_id_trigger_status_pin), io_trigger_on);
 }
 
 /* app commands */
 
+irom static bool_t io_config_dump_generator(string_t *dst, app_generator_state_t *state)
+{
+	return(io_config_dump(dst, state->parameter[0], state->parameter[1], false, &state->cursor));
+}
+
 irom app_action_t application_function_io_mode(const string_t *src, string_t *dst)
 {
 	const io_info_entry_t	*info;
@@ -1487,10 +1482,7 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	string_init(varname_io_lcd_pin, "io.%u.%u.lcd.pin");
 
 	if(parse_int(1, src, &io, 0, ' ') != parse_ok)
-	{
-		io_config_dump(dst, -1, -1, false);
-		return(app_action_normal);
-	}
+		return(application_generate(dst, io_config_dump_generator, -1, -1));
 
 	if((io < 0) || (io >= io_id_size))
 	{
@@ -1508,10 +1500,7 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	}
 
 	if(parse_int(2, src, &pin, 0, ' ') != parse_ok)
-	{
-		io_config_dump(dst, io, -1, false);
-		return(app_action_normal);
-	}
+		return(application_generate(dst, io_config_dump_generator, io, -1));
 
 	if((pin < 0) || (pin >= info->pins))
 	{
@@ -1525,7 +1514,7 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	if(parse_string(3, src, dst, ' ') != parse_ok)
 	{
 		string_clear(dst);
-		io_config_dump(dst, io, pin, false);
+		io_config_dump(dst, io, pin, false, (unsigned int *)0);
 		return(app_action_normal);
 	}
 
@@ -1982,7 +1971,7 @@ skip:
 		return(app_action_error);
 	}
 
-	io_config_dump(dst, io, pin, false);
+	io_config_dump(dst, io, pin, false, (unsigned int *)0);
 
 	return(app_action_normal);
 }
@@ -2380,24 +2369,46 @@ static const roflash dump_string_t roflash_dump_strings =
 	}
 };
 
-irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
+/*
+ * The dump can be made in chunks, *cursor holds the position to continue
+ * from: the io in the upper bits and in the lower byte 0 for the table
+ * header, 1 for the io header and 2 + n for pin n. Returns true when the
+ * dump is complete. Without a cursor it's made in one go, cut short
+ * when it doesn't fit.
+ */
+
+irom bool_t io_config_dump(string_t *dst, int io_id, int pin_id, bool html, unsigned int *cursor)
 {
 	const io_info_entry_t *info;
 	io_data_entry_t *data;
 	io_data_pin_entry_t *pin_data;
 	const io_config_pin_entry_t *pin_config;
 	const string_array_t *roflash_strings;
-	int io, pin, value;
+	unsigned int start = 0;
+	int io, pin, value, mark;
 	io_error_t error;
 
+	if(!cursor)
+		cursor = &start;
+
 	if(html)
 		roflash_strings = &roflash_dump_strings.html;
 	else
 		roflash_strings = &roflash_dump_strings.plain;
 
-	string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_start]);
+	if(*cursor == 0)
+	{
+		mark = string_length(dst);
 
-	for(io = 0; io < io_id_size; io++)
+		string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_start]);
+
+		if(!string_chunk_fits(dst, mark))
+			return(false);
+
+		*cursor = 1;
+	}
+
+	for(io = *cursor >> 8; io < io_id_size; io++, *cursor = (io << 8) | 1)
 	{
 		if((io_id >= 0) && (io_id != io))
 			continue;
@@ -2405,21 +2416,33 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 		info = &io_info[io];
 		data = &io_data[io];
 
-		string_format_flash_ptr(dst, (*roflash_strings)[ds_id_io], io, info->name, info->address);
-
-		if(!data->detected)
+		if((*cursor & 0xff) == 1)
 		{
-			string_append_cstr_flash(dst, (*roflash_strings)[ds_id_not_detected]);
-			continue;
+			mark = string_length(dst);
+
+			string_format_flash_ptr(dst, (*roflash_strings)[ds_id_io], io, info->name, info->address);
+
+			if(!data->detected)
+				string_append_cstr_flash(dst, (*roflash_strings)[ds_id_not_detected]);
+			else
+				string_append_cstr_flash(dst, (*roflash_strings)[ds_id_pins_header]);
+
+			if(!string_chunk_fits(dst, mark))
+				return(false);
+
+			*cursor = (io << 8) | 2;
 		}
 
-		string_append_cstr_flash(dst, (*roflash_strings)[ds_id_pins_header]);
+		if(!data->detected)
+			continue;
 
-		for(pin = 0; pin < info->pins; pin++)
+		for(pin = (*cursor & 0xff) - 2; pin < info->pins; pin++, *cursor = (io << 8) | (pin + 2))
 		{
 			if((pin_id >= 0) && (pin_id != pin))
 				continue;
 
+			mark = string_length(dst);
+
 			pin_config = &io_config[io][pin];
 			pin_data = &data->pin[pin];
 
@@ -2580,8 +2603,15 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 			string_append_cstr_flash(dst, (*roflash_strings)[ds_id_info_2]);
 
 			string_format_flash_ptr(dst, (*roflash_strings)[ds_id_pin_2], pin);
+
+			if(!string_chunk_fits(dst, mark))
+				return(false);
 		}
 	}
 
+	mark = string_length(dst);
+
 	string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_end]);
+
+	return(string_chunk_fits(dst, mark));
 }
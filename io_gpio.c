@@ -63,6 +63,9 @@ typedef enum
 {
 	io_uart_rx,
 	io_uart_tx,
+	io_uart_cts,
+	io_uart_rts,
+	io_uart_tx1,
 	io_uart_none,
 } io_uart_t;
 
@@ -97,7 +100,7 @@ static gpio_info_t gpio_info_table[io_gpio_pin_size] =
 {
 	{ true, 	PERIPHS_IO_MUX_GPIO0_U,		FUNC_GPIO0,		io_uart_none,	-1			},
 	{ true,		PERIPHS_IO_MUX_U0TXD_U,		FUNC_GPIO1,		io_uart_tx,		FUNC_U0TXD,	},
-	{ true,		PERIPHS_IO_MUX_GPIO2_U,		FUNC_GPIO2,		io_uart_none,	-1,			},
+	{ true,		PERIPHS_IO_MUX_GPIO2_U,		FUNC_GPIO2,		io_uart_tx1,	FUNC_U1TXD_BK	},
 	{ true,		PERIPHS_IO_MUX_U0RXD_U,		FUNC_GPIO3,		io_uart_rx,		FUNC_U0RXD	},
 	{ true,		PERIPHS_IO_MUX_GPIO4_U,		FUNC_GPIO4,		io_uart_none,	-1			},
 	{ true,		PERIPHS_IO_MUX_GPIO5_U,		FUNC_GPIO5,		io_uart_none,	-1			},
@@ -108,9 +111,9 @@ static gpio_info_t gpio_info_table[io_gpio_pin_size] =
 	{ false,	PERIPHS_IO_MUX_SD_DATA3_U,	FUNC_GPIO10,	io_uart_none,	-1			},
 	{ false,	PERIPHS_IO_MUX_SD_CMD_U,	FUNC_GPIO11,	io_uart_none,	-1			},
 	{ true,		PERIPHS_IO_MUX_MTDI_U,		FUNC_GPIO12,	io_uart_none,	-1			},
-	{ true,		PERIPHS_IO_MUX_MTCK_U, 		FUNC_GPIO13,	io_uart_none,	-1			},
+	{ true,		PERIPHS_IO_MUX_MTCK_U, 		FUNC_GPIO13,	io_uart_cts,	FUNC_U0CTS	},
 	{ true,		PERIPHS_IO_MUX_MTMS_U, 		FUNC_GPIO14,	io_uart_none,	-1			},
-	{ true,		PERIPHS_IO_MUX_MTDO_U, 		FUNC_GPIO15,	io_uart_none,	-1			},
+	{ true,		PERIPHS_IO_MUX_MTDO_U, 		FUNC_GPIO15,	io_uart_rts,	FUNC_U0RTS	},
 };
 
 // set GPIO direction
@@ -361,10 +364,8 @@ irom static void pwm_go(void)
 	unsigned int duty, delta, new_phase_set, pwm_period;
 	uint32_t timer_value;
 	bool_t isr_enabled;
-	string_init(varname_pwmperiod, "pwm.period");
 
-	if(!config_get_int(&varname_pwmperiod, -1, -1, &pwm_period))
-		pwm_period = 65536;
+	pwm_period = config_int(config_id_pwm_period);
 
 	isr_enabled = pwm_isr_enabled();
 	pwm_isr_enable(false);
@@ -708,13 +709,11 @@ irom io_error_t io_gpio_get_pin_info(string_t *dst, const struct io_info_entry_T
 {
 	gpio_data_pin_t *gpio_pin_data;
 	unsigned int pwm_period;
-	string_init(varname_pwmperiod, "pwm.period");
 
 	if((pin < 0) || (pin >= io_gpio_pin_size))
 		return(io_error);
 
-	if(!config_get_int(&varname_pwmperiod, -1, -1, &pwm_period))
-		pwm_period = 65536;
+	pwm_period = config_int(config_id_pwm_period);
 
 	gpio_pin_data = &gpio_data[pin];
 
@@ -762,7 +761,9 @@ irom io_error_t io_gpio_get_pin_info(string_t *dst, const struct io_info_entry_T
 
 			case(io_pin_ll_uart):
 			{
-				string_format(dst, "uart pin: %s", (gpio_info_table[pin].uart_pin == io_uart_rx) ? "rx" : "tx");
+				static const char *uart_pin_name[] = { "rx", "tx", "cts", "rts", "tx1" };
+
+				string_format(dst, "uart pin: %s", uart_pin_name[gpio_info_table[pin].uart_pin]);
 
 				break;
 			}
@@ -884,7 +885,6 @@ irom io_error_t io_gpio_write_pin(string_t *error_message, const struct io_info_
 irom app_action_t application_function_pwm_period(const string_t *src, string_t *dst)
 {
 	int new_pwm_period;
-	string_init(varname_pwmperiod, "pwm.period");
 
 	if(parse_int(1, src, &new_pwm_period, 0, ' ') == parse_ok)
 	{
@@ -894,13 +894,12 @@ irom app_action_t application_function_pwm_period(const string_t *src, string_t
 			return(app_action_error);
 		}
 
-		config_set_int(&varname_pwmperiod, -1, -1, new_pwm_period);
+		config_set_int_id(config_id_pwm_period, new_pwm_period);
 
 		pwm_go();
 	}
 
-	if(!config_get_int(&varname_pwmperiod, -1, -1, &new_pwm_period))
-		new_pwm_period = 65536;
+	new_pwm_period = config_int(config_id_pwm_period);
 
 	string_format(dst, "pwm_period: %d\n", new_pwm_period);
 
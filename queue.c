@@ -2,13 +2,44 @@
 
 #include "util.h"
 
+// make sure all memory accesses before this point have completed before
+// any access after it, also prevents the compiler from reordering them
+
+always_inline static void queue_barrier(void)
+{
+	__asm__ __volatile__("memw" : : : "memory");
+}
+
+attr_speed iram static int count_lf(const char *data, int length)
+{
+	int lf;
+
+	for(lf = 0; length > 0; length--)
+		if(*data++ == '\n')
+			lf++;
+
+	return(lf);
+}
+
+// a size that is not a power of two is rounded down to the nearest power of two
+
 irom void queue_new(queue_t *queue, int size, char *buffer)
 {
+	unsigned int pow2;
+
+	pow2 = 1;
+
+	while((pow2 << 1) <= (unsigned int)size)
+		pow2 <<= 1;
+
 	queue->data = buffer;
-	queue->size = size;
+	queue->size = pow2;
+	queue->mask = pow2 - 1;
 	queue->in = 0;
 	queue->out = 0;
-	queue->lf = 0;
+	queue->lf_in = 0;
+	queue->lf_out = 0;
+	queue->overflow = 0;
 }
 
 attr_speed iram attr_pure char queue_empty(const queue_t *queue)
@@ -18,39 +49,264 @@ attr_speed iram attr_pure char queue_empty(const queue_t *queue)
 
 attr_speed iram attr_pure char queue_full(const queue_t *queue)
 {
-	return(((queue->in + 1) % queue->size) == queue->out);
+	return((queue->in - queue->out) >= queue->size);
 }
 
 attr_speed iram attr_pure int queue_lf(const queue_t *queue)
 {
-	return(queue->lf);
+	return(queue->lf_in - queue->lf_out);
 }
 
+attr_speed iram attr_pure int queue_length(const queue_t *queue)
+{
+	return(queue->in - queue->out);
+}
+
+attr_speed iram attr_pure int queue_space(const queue_t *queue)
+{
+	return(queue->size - (queue->in - queue->out));
+}
+
+attr_speed iram attr_pure unsigned int queue_overflow(const queue_t *queue)
+{
+	return(queue->overflow);
+}
+
+// consumer side, discard everything currently in the queue
+
 attr_speed iram void queue_flush(queue_t *queue)
 {
-	queue->in = 0;
-	queue->out = 0;
-	queue->lf = 0;
+	queue_skip(queue, queue_length(queue));
 }
 
-attr_speed iram void queue_push(queue_t *queue, char data)
+// producer side, returns false and counts an overflow if the queue is full
+
+attr_speed iram char queue_push(queue_t *queue, char data)
 {
+	unsigned int in = queue->in;
+
+	if((in - queue->out) >= queue->size)
+	{
+		queue->overflow++;
+		return(0);
+	}
+
+	queue->data[in & queue->mask] = data;
+
 	if(data == '\n')
-		queue->lf++;
+		queue->lf_in++;
 
-	queue->data[queue->in] = data;
-	queue->in = (queue->in + 1) % queue->size;
+	queue_barrier();
+	queue->in = in + 1;
+
+	return(1);
 }
 
+// consumer side, the queue must not be empty
+
 attr_speed iram char queue_pop(queue_t *queue)
 {
+	unsigned int out = queue->out;
 	char data;
 
-	data = queue->data[queue->out];
-	queue->out = (queue->out + 1) % queue->size;
+	data = queue->data[out & queue->mask];
 
 	if(data == '\n')
-		queue->lf--;
+		queue->lf_out++;
+
+	queue_barrier();
+	queue->out = out + 1;
 
 	return(data);
 }
+
+// producer side, copy up to length bytes into the queue as at most two
+// memcpy segments, returns the amount of bytes actually queued, the rest
+// is counted as overflow
+
+attr_speed iram int queue_push_n(queue_t *queue, int length, const char *data)
+{
+	unsigned int in = queue->in;
+	int space, chunk, offset;
+
+	space = queue->size - (in - queue->out);
+
+	if(length > space)
+	{
+		queue->overflow += length - space;
+		length = space;
+	}
+
+	if(length <= 0)
+		return(0);
+
+	offset = in & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > length)
+		chunk = length;
+
+	memcpy(queue->data + offset, data, chunk);
+
+	if(chunk < length)
+		memcpy(queue->data, data + chunk, length - chunk);
+
+	queue->lf_in += count_lf(data, length);
+
+	queue_barrier();
+	queue->in = in + length;
+
+	return(length);
+}
+
+// consumer side, copy up to length bytes out of the queue as at most two
+// memcpy segments, returns the amount of bytes actually dequeued
+
+attr_speed iram int queue_pop_n(queue_t *queue, int length, char *data)
+{
+	unsigned int out = queue->out;
+	int available, chunk, offset;
+
+	available = queue->in - out;
+
+	if(length > available)
+		length = available;
+
+	if(length <= 0)
+		return(0);
+
+	queue_barrier();
+
+	offset = out & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > length)
+		chunk = length;
+
+	memcpy(data, queue->data + offset, chunk);
+
+	if(chunk < length)
+		memcpy(data + chunk, queue->data, length - chunk);
+
+	queue->lf_out += count_lf(data, length);
+
+	queue_barrier();
+	queue->out = out + length;
+
+	return(length);
+}
+
+// consumer side, return the contiguous span of queued data starting at the
+// read pointer, up to the wrap point, without dequeueing it; the span isn't
+// const, so it can be handed to the send functions as it is
+
+attr_speed iram int queue_peek(const queue_t *queue, char **data)
+{
+	unsigned int out = queue->out;
+	int length, offset, chunk;
+
+	length = queue->in - out;
+	offset = out & queue->mask;
+	chunk = queue->size - offset;
+
+	queue_barrier();
+
+	*data = queue->data + offset;
+
+	return((length < chunk) ? length : chunk);
+}
+
+// consumer side, copy up to length bytes out of the queue without dequeueing
+// them, returns the amount of bytes copied
+
+attr_speed iram int queue_peek_n(const queue_t *queue, int length, char *data)
+{
+	unsigned int out = queue->out;
+	int available, chunk, offset;
+
+	available = queue->in - out;
+
+	if(length > available)
+		length = available;
+
+	if(length <= 0)
+		return(0);
+
+	queue_barrier();
+
+	offset = out & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > length)
+		chunk = length;
+
+	memcpy(data, queue->data + offset, chunk);
+
+	if(chunk < length)
+		memcpy(data + chunk, queue->data, length - chunk);
+
+	return(length);
+}
+
+// consumer side, find the first occurrence of byte in the queue,
+// returns the length of the data up to and including it, or 0 if not found
+
+irom int queue_find(const queue_t *queue, char byte)
+{
+	unsigned int out = queue->out;
+	int length, chunk, offset;
+	const char *found;
+
+	length = queue->in - out;
+
+	if(length <= 0)
+		return(0);
+
+	queue_barrier();
+
+	offset = out & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > length)
+		chunk = length;
+
+	if((found = memchr(queue->data + offset, byte, chunk)))
+		return((found - (queue->data + offset)) + 1);
+
+	if((chunk < length) && (found = memchr(queue->data, byte, length - chunk)))
+		return(chunk + (found - queue->data) + 1);
+
+	return(0);
+}
+
+// consumer side, drop length bytes from the queue, usually after queue_peek
+
+attr_speed iram void queue_skip(queue_t *queue, int length)
+{
+	unsigned int out = queue->out;
+	int available, chunk, offset;
+
+	available = queue->in - out;
+
+	if(length > available)
+		length = available;
+
+	if(length <= 0)
+		return;
+
+	queue_barrier();
+
+	offset = out & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > length)
+		chunk = length;
+
+	queue->lf_out += count_lf(queue->data + offset, chunk);
+
+	if(chunk < length)
+		queue->lf_out += count_lf(queue->data, length - chunk);
+
+	queue_barrier();
+	queue->out = out + length;
+}
@@ -3,21 +3,54 @@
 
 #include <stdint.h>
 
+/*
+ * Single producer / single consumer ring buffer.
+ *
+ * The size is always a power of two. The in and out counters are
+ * free-running and only masked when indexing the buffer, so full and empty
+ * are simple subtractions and all size slots can be used.
+ *
+ * Ownership: in, lf_in and overflow are only ever written by the producer,
+ * out and lf_out only by the consumer. The producer stores the data before
+ * publishing the new value of in, the consumer reads the data before
+ * publishing the new value of out, with a memory barrier in between. This
+ * makes it safe to have one side in an interrupt handler and the other side
+ * in task context without disabling interrupts.
+ *
+ * Overflow policy: when the queue is full, new data is dropped (the oldest
+ * data is never overwritten) and the overflow counter is incremented.
+ *
+ * queue_flush is a consumer operation, the producer must never call it
+ * unless the consumer side is known not to run (e.g. interrupts disabled).
+ */
+
 typedef struct
 {
 	char *data;
-	int size;
-	int in;
-	int out;
-	int lf;
+	unsigned int size;
+	unsigned int mask;
+	volatile unsigned int in;
+	volatile unsigned int out;
+	volatile unsigned int lf_in;
+	volatile unsigned int lf_out;
+	volatile unsigned int overflow;
 } queue_t;
 
 void queue_new(queue_t *queue, int size, char *buffer);
 char queue_empty(const queue_t *queue);
 char queue_full(const queue_t *queue);
 int queue_lf(const queue_t *queue);
+int queue_length(const queue_t *queue);
+int queue_space(const queue_t *queue);
+unsigned int queue_overflow(const queue_t *queue);
 void queue_flush(queue_t *queue);
-void queue_push(queue_t *queue, char data);
+char queue_push(queue_t *queue, char data);
 char queue_pop(queue_t *queue);
+int queue_push_n(queue_t *queue, int length, const char *data);
+int queue_pop_n(queue_t *queue, int length, char *data);
+int queue_peek(const queue_t *queue, char **data);
+int queue_peek_n(const queue_t *queue, int length, char *data);
+int queue_find(const queue_t *queue, char byte);
+void queue_skip(queue_t *queue, int length);
 
 #endif
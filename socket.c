@@ -3,12 +3,23 @@
 #include "stats.h"
 
 static unsigned int sockets_length = 0;
-static socket_t *sockets[2];
+static socket_t *sockets[socket_max_sockets];
+
+// All espconns of a socket, including the accepted tcp children, point back
+// to it through their reverse field. The pointer is only trusted when the
+// registry agrees, otherwise (e.g. the sdk passing a copy of the espconn)
+// the socket is looked up by local port.
 
 iram static socket_t *find_socket(struct espconn *esp_socket)
 {
+	socket_t *socket = (socket_t *)esp_socket->reverse;
 	unsigned int ix;
 
+	if(socket && (socket->id < sockets_length) && (sockets[socket->id] == socket))
+		return(socket);
+
+	stat_socket_slow_lookups++;
+
 	switch(esp_socket->type)
 	{
 		case(ESPCONN_TCP):
@@ -33,18 +44,43 @@ iram static socket_t *find_socket(struct espconn *esp_socket)
 	return((socket_t *)0);
 }
 
-iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
+iram static int find_child(socket_t *socket, struct espconn *esp_socket)
+{
+	socket_child_t *child;
+	int ix;
+
+	for(ix = 0; ix < socket->tcp.max_children; ix++)
+		if(socket->tcp.child[ix].esp_socket == esp_socket)
+			return(ix);
+
+	// the sdk doesn't always pass the espconn it passed on accept, fall back to the peer's address
+
+	for(ix = 0; ix < socket->tcp.max_children; ix++)
+	{
+		child = &socket->tcp.child[ix];
+
+		if(child->esp_socket &&
+				(child->port == esp_socket->proto.tcp->remote_port) &&
+				(child->address.byte[0] == esp_socket->proto.tcp->remote_ip[0]) &&
+				(child->address.byte[1] == esp_socket->proto.tcp->remote_ip[1]) &&
+				(child->address.byte[2] == esp_socket->proto.tcp->remote_ip[2]) &&
+				(child->address.byte[3] == esp_socket->proto.tcp->remote_ip[3]))
+			return(ix);
+	}
+
+	return(-1);
+}
+
+iram static void set_remote(struct espconn *esp_socket, socket_t *socket, int child)
 {
 	switch(esp_socket->type)
 	{
 		case(ESPCONN_TCP):
 		{
 			socket->remote.proto			= proto_tcp;
-			socket->remote.port				= 0;
-			socket->remote.address.byte[0]	= 0;
-			socket->remote.address.byte[1]	= 0;
-			socket->remote.address.byte[2]	= 0;
-			socket->remote.address.byte[3]	= 0;
+			socket->remote.child			= child;
+			socket->remote.port				= socket->tcp.child[child].port;
+			socket->remote.address.ip_addr	= socket->tcp.child[child].address.ip_addr;
 
 			break;
 		}
@@ -56,6 +92,7 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 			espconn_get_connection_info(esp_socket, &remote, 0);
 
 			socket->remote.proto			= proto_udp;
+			socket->remote.child			= -1;
 			socket->remote.port				= remote->remote_port;
 			socket->remote.address.byte[0]	= remote->remote_ip[0];
 			socket->remote.address.byte[1]	= remote->remote_ip[1];
@@ -68,6 +105,7 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 		default:
 		{
 			socket->remote.proto			= proto_none;
+			socket->remote.child			= -1;
 			socket->remote.port				= 0;
 			socket->remote.address.byte[0]	= 0;
 			socket->remote.address.byte[1]	= 0;
@@ -79,6 +117,251 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 	}
 }
 
+// find the socket and, for tcp, the child the event is about; only received
+// data makes the sender the current remote, so a reply still goes to where
+// the last request came from
+
+iram static socket_t *find_remote(struct espconn *esp_socket, bool_t received)
+{
+	socket_t *socket;
+	int child = -1;
+
+	if(!(socket = find_socket(esp_socket)))
+		return((socket_t *)0);
+
+	if((esp_socket->type == ESPCONN_TCP) && ((child = find_child(socket, esp_socket)) < 0))
+		return((socket_t *)0);
+
+	socket->event_child = child;
+
+	if(received)
+		set_remote(esp_socket, socket, child);
+
+	return(socket);
+}
+
+irom static void release_child(socket_t *socket, int child)
+{
+	socket->tcp.child[child].esp_socket	= (struct espconn *)0;
+	socket->tcp.child[child].send_busy	= false;
+	socket->tcp.children--;
+
+	if((socket->tcp.children == 0) && (socket->remote.proto == proto_tcp))
+	{
+		socket->remote.proto	= proto_none;
+		socket->remote.child	= -1;
+	}
+}
+
+iram static bool_t send_child(socket_t *socket, int child, char *data, int length)
+{
+	socket_child_t *tcp_child = &socket->tcp.child[child];
+
+	if(!tcp_child->esp_socket || tcp_child->send_busy)
+		return(false);
+
+	tcp_child->send_busy = true;
+
+	if(espconn_send(tcp_child->esp_socket, data, length) == 0)
+		return(true);
+
+	tcp_child->send_busy = false;
+	return(false);
+}
+
+iram static bool_t send_remote(socket_t *socket, const socket_remote_t *remote, char *data, int length)
+{
+	struct espconn *esp_socket;
+
+	switch(remote->proto)
+	{
+		case(proto_tcp):
+		{
+			return(send_child(socket, remote->child, data, length));
+		}
+
+		case(proto_udp):
+		{
+			if(socket->send_busy)
+				goto error;
+
+			esp_socket = &socket->udp.socket;
+			esp_socket->proto.udp->remote_port	= remote->port;
+			esp_socket->proto.udp->remote_ip[0]	= remote->address.byte[0];
+			esp_socket->proto.udp->remote_ip[1]	= remote->address.byte[1];
+			esp_socket->proto.udp->remote_ip[2]	= remote->address.byte[2];
+			esp_socket->proto.udp->remote_ip[3]	= remote->address.byte[3];
+			break;
+		}
+
+		default:
+		{
+			goto error;
+		}
+	}
+
+	socket->send_busy = true;
+
+	if(espconn_send(esp_socket, data, length) == 0)
+		return(true);
+
+	socket->send_busy = false;
+
+error:
+	return(false);
+}
+
+// data for the same tcp client is appended to the newest chunk while that
+// one isn't in flight yet, so replies made back to back go out as one
+// segment; udp chunks are always kept apart, one per datagram
+
+iram static bool_t backlog_append(socket_t *socket, const string_t *buffer)
+{
+	socket_backlog_t *backlog = &socket->backlog;
+	socket_backlog_entry_t *last;
+	int length, start, end;
+
+	length = string_length(buffer);
+
+	if((backlog->entries == 0) || ((backlog->entries == 1) && backlog->in_flight) || (socket->remote.proto != proto_tcp))
+		return(false);
+
+	last = &backlog->entry[(backlog->first + backlog->entries - 1) % socket_backlog_max_depth];
+
+	if((last->remote.proto != proto_tcp) || (last->remote.child != socket->remote.child))
+		return(false);
+
+	start = backlog->entry[backlog->first].offset;
+	end = last->offset + last->length;
+
+	if((end > start) ? ((end + length) > backlog->size) : ((end + length) > start))
+		return(false);
+
+	memcpy(backlog->buffer + end, string_buffer(buffer), length);
+	last->length += length;
+
+	return(true);
+}
+
+// find room for a chunk after the newest one, or at the start of the
+// buffer if it doesn't fit at the end, without overwriting the oldest one
+
+iram static bool_t backlog_add(socket_t *socket, const string_t *buffer)
+{
+	socket_backlog_t *backlog = &socket->backlog;
+	const socket_backlog_entry_t *last;
+	socket_backlog_entry_t *entry;
+	int length, offset, start, end, used;
+
+	length = string_length(buffer);
+
+	if((length > 0) && backlog_append(socket, buffer))
+		return(true);
+
+	if((length == 0) || (length > backlog->size) || (backlog->entries >= backlog->depth))
+		goto full;
+
+	if(backlog->entries == 0)
+		offset = 0;
+	else
+	{
+		last = &backlog->entry[(backlog->first + backlog->entries - 1) % socket_backlog_max_depth];
+		start = backlog->entry[backlog->first].offset;
+		end = last->offset + last->length;
+
+		if(end > start)
+		{
+			if((end + length) <= backlog->size)
+				offset = end;
+			else
+				if(length <= start)
+					offset = 0;
+				else
+					goto full;
+		}
+		else
+		{
+			if((end + length) <= start)
+				offset = end;
+			else
+				goto full;
+		}
+	}
+
+	entry = &backlog->entry[(backlog->first + backlog->entries) % socket_backlog_max_depth];
+	entry->offset = offset;
+	entry->length = length;
+	entry->remote = socket->remote;
+
+	memcpy(backlog->buffer + offset, string_buffer(buffer), length);
+
+	backlog->entries++;
+
+	if(backlog->entries > stat_socket_backlog_max_entries)
+		stat_socket_backlog_max_entries = backlog->entries;
+
+	used = (offset + length) - backlog->entry[backlog->first].offset;
+
+	if(used <= 0)
+		used += backlog->size;
+
+	if(used > stat_socket_backlog_max_bytes)
+		stat_socket_backlog_max_bytes = used;
+
+	return(true);
+
+full:
+	stat_socket_backlog_full++;
+	return(false);
+}
+
+iram static void backlog_drop_first(socket_backlog_t *backlog)
+{
+	backlog->first = (backlog->first + 1) % socket_backlog_max_depth;
+	backlog->entries--;
+	backlog->in_flight = false;
+}
+
+// start sending the oldest chunk, unless a send from the backlog is already
+// in flight; chunks for a tcp client that has gone are dropped; in_flight is
+// set before sending, as for udp the sent callback is called from within
+// espconn_send(); a chunk that can't be sent now stays, see socket_retry()
+
+iram static void backlog_kick(socket_t *socket)
+{
+	socket_backlog_t *backlog = &socket->backlog;
+	socket_backlog_entry_t *entry;
+
+	while(!backlog->in_flight && (backlog->entries > 0))
+	{
+		entry = &backlog->entry[backlog->first];
+
+		if((entry->remote.proto == proto_tcp) && !socket_child_connected(socket, entry->remote.child))
+		{
+			backlog_drop_first(backlog);
+			continue;
+		}
+
+		backlog->in_flight = true;
+
+		if(!send_remote(socket, &entry->remote, backlog->buffer + entry->offset, entry->length))
+			backlog->in_flight = false;
+
+		break;
+	}
+}
+
+// drop the chunk in flight when its tcp client has gone, there won't be a sent callback for it
+
+iram static void backlog_drop_child(socket_t *socket, int child)
+{
+	socket_backlog_t *backlog = &socket->backlog;
+	const socket_backlog_entry_t *entry = &backlog->entry[backlog->first];
+
+	if(backlog->in_flight && (entry->remote.proto == proto_tcp) && (entry->remote.child == child))
+		backlog_drop_first(backlog);
+}
+
 static void socket_callback_sent(void *arg);
 static void socket_callback_received(void *arg, char *buffer, unsigned short length);
 static void socket_callback_disconnect(void *arg);
@@ -87,28 +370,47 @@ static void socket_callback_error(void *arg, int8_t error);
 irom static void socket_callback_accept(void *arg)
 {
 	struct espconn *new_esp_socket = (struct espconn *)arg;
+	socket_child_t *child;
 	socket_t *socket;
+	int ix;
 
 	if(!(socket = find_socket(new_esp_socket)))
 		goto disconnect;
 
-	if(socket->tcp.child_socket)
+	for(ix = 0; ix < socket->tcp.max_children; ix++)
+		if(!socket_child_connected(socket, ix))
+			break;
+
+	if(ix >= socket->tcp.max_children)
 		goto disconnect;
 
-	socket->tcp.child_socket = new_esp_socket;
+	child = &socket->tcp.child[ix];
+
+	new_esp_socket->reverse	= socket;
+
+	child->esp_socket		= new_esp_socket;
+	child->send_busy		= false;
+	child->port				= new_esp_socket->proto.tcp->remote_port;
+	child->address.byte[0]	= new_esp_socket->proto.tcp->remote_ip[0];
+	child->address.byte[1]	= new_esp_socket->proto.tcp->remote_ip[1];
+	child->address.byte[2]	= new_esp_socket->proto.tcp->remote_ip[2];
+	child->address.byte[3]	= new_esp_socket->proto.tcp->remote_ip[3];
+
+	socket->tcp.children++;
 
-	set_remote(new_esp_socket, socket);
+	socket->event_child = ix;
+	set_remote(new_esp_socket, socket, ix);
 
-	espconn_regist_recvcb(socket->tcp.child_socket,		socket_callback_received);
-	espconn_regist_sentcb(socket->tcp.child_socket,		socket_callback_sent);
-	espconn_regist_disconcb(socket->tcp.child_socket,	socket_callback_disconnect);
-	espconn_regist_reconcb(socket->tcp.child_socket,	socket_callback_error);
+	espconn_regist_recvcb(new_esp_socket,	socket_callback_received);
+	espconn_regist_sentcb(new_esp_socket,	socket_callback_sent);
+	espconn_regist_disconcb(new_esp_socket,	socket_callback_disconnect);
+	espconn_regist_reconcb(new_esp_socket,	socket_callback_error);
 
-	//espconn_set_opt(socket->tcp.child_socket, ESPCONN_REUSEADDR | ESPCONN_NODELAY);
-	espconn_set_opt(socket->tcp.child_socket, ESPCONN_REUSEADDR);
+	//espconn_set_opt(new_esp_socket, ESPCONN_REUSEADDR | ESPCONN_NODELAY);
+	espconn_set_opt(new_esp_socket, ESPCONN_REUSEADDR);
 
 	if(socket->callback_accept)
-		socket->callback_accept(socket, socket->tcp.child_socket);
+		socket->callback_accept(socket, socket->userdata);
 
 	return;
 
@@ -122,11 +424,9 @@ iram static void socket_callback_received(void *arg, char *buffer, unsigned shor
 	socket_t		*socket;
 	struct espconn	*esp_socket = (struct espconn *)arg;
 
-	if(!(socket = find_socket(esp_socket)))
+	if(!(socket = find_remote(esp_socket, true)))
 		return;
 
-	set_remote(esp_socket, socket);
-
 	if(socket->callback_received)
 	{
 		string_set(&string_buffer, buffer, length, length);
@@ -139,13 +439,24 @@ iram static void socket_callback_sent(void *arg)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
-	if(!(socket = find_socket(esp_socket)))
+	if(!(socket = find_remote(esp_socket, false)))
 		return;
 
+	// clear busy first, so the callback can start the next send
+
+	if(socket->event_child >= 0)
+		socket->tcp.child[socket->event_child].send_busy = false;
+	else
+		socket->send_busy = false;
+
+	if(socket->backlog.in_flight)
+	{
+		backlog_drop_first(&socket->backlog);
+		backlog_kick(socket);
+	}
+
 	if(socket->callback_sent)
 		socket->callback_sent(socket, socket->userdata);
-
-	socket->send_busy = false;
 }
 
 irom static void socket_callback_error(void *arg, int8_t error)
@@ -153,13 +464,28 @@ irom static void socket_callback_error(void *arg, int8_t error)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
-	if(!(socket = find_socket(esp_socket)))
+	if(!(socket = find_remote(esp_socket, false)))
 		return;
 
 	if(socket->callback_error)
 		socket->callback_error(socket, error, socket->userdata);
 
-	socket->send_busy = false;
+	// the connection is gone after an error, no disconnect callback follows
+
+	if(socket->event_child >= 0)
+	{
+		backlog_drop_child(socket, socket->event_child);
+		release_child(socket, socket->event_child);
+	}
+	else
+	{
+		socket->send_busy = false;
+
+		if(socket->backlog.in_flight)
+			backlog_drop_first(&socket->backlog);
+	}
+
+	backlog_kick(socket);
 }
 
 irom static void socket_callback_disconnect(void *arg)
@@ -167,63 +493,72 @@ irom static void socket_callback_disconnect(void *arg)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
-	if(!(socket = find_socket(esp_socket)))
+	if(!(socket = find_remote(esp_socket, false)))
 		return;
 
 	if(socket->callback_disconnect)
 		socket->callback_disconnect(socket, socket->userdata);
 
-	socket->tcp.child_socket	= (struct espconn *)0;
-	socket->remote.proto		= proto_none;
+	if(socket->event_child >= 0)
+	{
+		backlog_drop_child(socket, socket->event_child);
+		release_child(socket, socket->event_child);
+	}
 
-	socket->send_busy = false;
+	backlog_kick(socket);
 }
 
-iram bool_t socket_send(socket_t *socket, string_t *buffer)
+iram bool_t socket_send_child(socket_t *socket, int child, string_t *buffer)
 {
-	struct espconn *esp_socket;
+	return(send_child(socket, child, string_buffer_nonconst(buffer), string_length(buffer)));
+}
 
-	if(socket->send_busy)
-		goto error;
+// send to a given remote instead of the last one, without the backlog
 
-	switch(socket->remote.proto)
-	{
-		case(proto_tcp):
-		{
-			esp_socket = socket->tcp.child_socket;
-			break;
-		}
+iram bool_t socket_send_to(socket_t *socket, const socket_remote_t *remote, string_t *buffer)
+{
+	return(send_remote(socket, remote, string_buffer_nonconst(buffer), string_length(buffer)));
+}
 
-		case(proto_udp):
-		{
+// Without a backlog the buffer is sent as is and must be left alone until
+// the sent callback. With a backlog the data is copied and the buffer can
+// be reused right away, false is returned when the backlog is full.
 
-			esp_socket = &socket->udp.socket;
-			esp_socket->proto.udp->remote_port	= socket->remote.port;
-			esp_socket->proto.udp->remote_ip[0]	= socket->remote.address.byte[0];
-			esp_socket->proto.udp->remote_ip[1]	= socket->remote.address.byte[1];
-			esp_socket->proto.udp->remote_ip[2]	= socket->remote.address.byte[2];
-			esp_socket->proto.udp->remote_ip[3]	= socket->remote.address.byte[3];
-			break;
-		}
+iram bool_t socket_send(socket_t *socket, string_t *buffer)
+{
+	if(socket->backlog.depth == 0)
+		return(send_remote(socket, &socket->remote, string_buffer_nonconst(buffer), string_length(buffer)));
 
-		default:
-		{
-			goto error;
-		}
-	}
+	if(!backlog_add(socket, buffer))
+		return(false);
 
-	socket->send_busy = true;
+	backlog_kick(socket);
 
-	if(espconn_send(esp_socket, string_buffer_nonconst(buffer), string_length(buffer)) == 0)
-		return(true);
+	return(true);
+}
 
-error:
-	socket->send_busy = false;
-	return(false);
+iram void socket_retry(socket_t *socket)
+{
+	backlog_kick(socket);
+}
+
+irom void socket_backlog(socket_t *socket, int depth, int size, char *buffer)
+{
+	if(depth > socket_backlog_max_depth)
+		depth = socket_backlog_max_depth;
+
+	socket->backlog.buffer = buffer;
+	socket->backlog.size = size;
+	socket->backlog.depth = depth;
+	socket->backlog.entries = 0;
+	socket->backlog.first = 0;
+	socket->backlog.in_flight = false;
 }
 
-irom void socket_create(bool tcp, bool udp, socket_t *socket,
-		int port, int timeout,
+// returns false when all socket slots are in use, the socket isn't usable then
+
+irom bool_t socket_create(bool tcp, bool udp, socket_t *socket,
+		int port, int timeout, int max_children,
 		void (*callback_received)(socket_t *, const string_t *, void *userdata),
 		void (*callback_sent)(socket_t *, void *userdata),
 		void (*callback_error)(socket_t *, int, void *userdata),
@@ -231,24 +566,32 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		void (*callback_accept)(socket_t *, void *userdata),
 		void *userdata)
 {
-	if(sockets_length >= (sizeof(sockets) / sizeof(*sockets)))
-		return;
+	if(sockets_length >= socket_max_sockets)
+		return(false);
 
+	socket->id = sockets_length;
 	sockets[sockets_length++] = socket;
 
 	if(tcp)
 	{
 		memset(&socket->tcp.config, 0, sizeof(socket->tcp.config));
 		memset(&socket->tcp.listen_socket, 0, sizeof(socket->tcp.listen_socket));
-		socket->tcp.child_socket = (struct espconn *)0;
+		memset(&socket->tcp.child, 0, sizeof(socket->tcp.child));
+
+		if((max_children < 1) || (max_children > socket_max_children))
+			max_children = 1;
+
+		socket->tcp.max_children = max_children;
+		socket->tcp.children = 0;
 
 		socket->tcp.config.local_port		= port;
 		socket->tcp.listen_socket.proto.tcp	= &socket->tcp.config;
 		socket->tcp.listen_socket.type		= ESPCONN_TCP;
 		socket->tcp.listen_socket.state		= ESPCONN_NONE;
+		socket->tcp.listen_socket.reverse	= socket;
 
 		espconn_regist_connectcb(&socket->tcp.listen_socket, socket_callback_accept);
-		espconn_tcp_set_max_con_allow(&socket->tcp.listen_socket, 1);
+		espconn_tcp_set_max_con_allow(&socket->tcp.listen_socket, max_children);
 
 		espconn_accept(&socket->tcp.listen_socket);
 		espconn_regist_time(&socket->tcp.listen_socket, timeout, 0); // this must come after accept()
@@ -263,6 +606,7 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		socket->udp.socket.proto.udp	= &socket->udp.config;
 		socket->udp.socket.type			= ESPCONN_UDP;
 		socket->udp.socket.state		= ESPCONN_NONE;
+		socket->udp.socket.reverse		= socket;
 
 		espconn_regist_recvcb(&socket->udp.socket, socket_callback_received);
 		espconn_regist_sentcb(&socket->udp.socket, socket_callback_sent);
@@ -270,19 +614,25 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		espconn_create(&socket->udp.socket);
 	}
 
-	socket->remote.proto	= proto_none;
 	socket->send_busy		= false;
 
+	socket_backlog(socket, 0, 0, (char *)0);
+
 	socket->remote.proto			= proto_none;
+	socket->remote.child			= -1;
 	socket->remote.port				= 0;
 	socket->remote.address.byte[0]	= 0;
 	socket->remote.address.byte[1]	= 0;
 	socket->remote.address.byte[2]	= 0;
 	socket->remote.address.byte[3]	= 0;
+	socket->event_child				= -1;
 
 	socket->callback_received	= callback_received;
 	socket->callback_sent		= callback_sent;
 	socket->callback_error		= callback_error;
 	socket->callback_disconnect	= callback_disconnect;
 	socket->callback_accept		= callback_accept;
+	socket->userdata			= userdata;
+
+	return(true);
 }
@@ -13,6 +13,51 @@ typedef enum
 	proto_both,
 } socket_proto_t;
 
+enum
+{
+	socket_max_sockets = 4,
+	socket_max_children = 4,
+	socket_backlog_max_depth = 8,
+};
+
+typedef struct
+{
+	socket_proto_t		proto;
+	int					child; // tcp child, -1 for udp
+	int					port;
+	ip_addr_to_bytes_t	address;
+} socket_remote_t;
+
+// The backlog holds copies of outgoing data while a previous send hasn't
+// completed. It's a ring of variable sized, contiguous chunks, as espconn
+// can't send from a buffer that wraps.
+
+typedef struct
+{
+	int				offset;
+	int				length;
+	socket_remote_t	remote;
+} socket_backlog_entry_t;
+
+typedef struct
+{
+	char					*buffer;
+	int						size;
+	int						depth;
+	int						entries;
+	int						first;
+	bool_t					in_flight;
+	socket_backlog_entry_t	entry[socket_backlog_max_depth];
+} socket_backlog_t;
+
+typedef struct
+{
+	struct espconn		*esp_socket;
+	bool_t				send_busy;
+	int					port;
+	ip_addr_to_bytes_t	address;
+} socket_child_t;
+
 typedef struct _socket_t
 {
 	struct
@@ -25,17 +70,17 @@ typedef struct _socket_t
 	{
 		esp_tcp			config;
 		struct espconn	listen_socket;
-		struct espconn	*child_socket;
+		int				max_children;
+		int				children;
+		socket_child_t	child[socket_max_children];
 	} tcp;
 
-	bool_t			send_busy;
+	unsigned int	id; // index in the socket registry
+	bool_t			send_busy; // udp only, tcp children each have their own
 
-	struct
-	{
-		socket_proto_t		proto;
-		int					port;
-		ip_addr_to_bytes_t	address;
-	} remote;
+	socket_remote_t		remote; // where the last data came from, replies go here
+	int					event_child; // tcp child the current callback is about, -1 for udp
+	socket_backlog_t	backlog;
 
 	void (*callback_received)(struct _socket_t *, const string_t *, void *userdata);
 	void (*callback_sent)(struct _socket_t *, void *userdata);
@@ -46,9 +91,13 @@ typedef struct _socket_t
 } socket_t;
 
 bool_t socket_send(socket_t *socket, string_t *);
+bool_t socket_send_child(socket_t *socket, int child, string_t *);
+bool_t socket_send_to(socket_t *socket, const socket_remote_t *remote, string_t *);
+void socket_backlog(socket_t *socket, int depth, int size, char *buffer);
+void socket_retry(socket_t *socket);
 
-void socket_create(bool tcp, bool udp, socket_t *socket,
-		int port, int timeout,
+bool_t socket_create(bool tcp, bool udp, socket_t *socket,
+		int port, int timeout, int max_children,
 		void (*callback_received)(socket_t *, const string_t *, void *userdata),
 		void (*callback_sent)(socket_t *, void *userdata),
 		void (*callback_error)(socket_t *, int, void *userdata),
@@ -66,10 +115,50 @@ always_inline static void *socket_userdata(socket_t *socket)
 	return(socket->userdata);
 }
 
+// data is queued in the backlog or being sent from it
+
+always_inline static bool_t socket_send_pending(socket_t *socket)
+{
+	return(socket->backlog.entries > 0);
+}
+
+always_inline static int socket_children(socket_t *socket)
+{
+	return(socket->tcp.children);
+}
+
+always_inline static bool_t socket_child_connected(socket_t *socket, int child)
+{
+	return(socket->tcp.child[child].esp_socket != (struct espconn *)0);
+}
+
+// stop/restart receiving from all tcp peers, no effect on udp
+
+always_inline static void socket_hold(socket_t *socket)
+{
+	int child;
+
+	for(child = 0; child < socket->tcp.max_children; child++)
+		if(socket_child_connected(socket, child))
+			espconn_recv_hold(socket->tcp.child[child].esp_socket);
+}
+
+always_inline static void socket_unhold(socket_t *socket)
+{
+	int child;
+
+	for(child = 0; child < socket->tcp.max_children; child++)
+		if(socket_child_connected(socket, child))
+			espconn_recv_unhold(socket->tcp.child[child].esp_socket);
+}
+
 always_inline static void socket_disconnect_accepted(socket_t *socket)
 {
-	if(socket->tcp.child_socket != (struct espconn *)0)
-		espconn_disconnect(socket->tcp.child_socket);
+	int child;
+
+	for(child = 0; child < socket->tcp.max_children; child++)
+		if(socket_child_connected(socket, child))
+			espconn_disconnect(socket->tcp.child[child].esp_socket);
 }
 
 #endif
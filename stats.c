@@ -4,6 +4,7 @@
 #include "config.h"
 #include "time.h"
 #include "i2c.h"
+#include "user_main.h"
 
 #include <c_types.h>
 #include <user_interface.h>
@@ -29,9 +30,28 @@ int stat_pc_counts;
 int stat_i2c_init_time_us;
 int stat_display_init_time_us;
 int stat_cmd_receive_buffer_overflow;
+int stat_cmd_receive_rejected;
 int stat_cmd_send_buffer_overflow;
 int stat_uart_receive_buffer_overflow;
 int stat_uart_send_buffer_overflow;
+int stat_socket_slow_lookups;
+int stat_socket_backlog_max_entries;
+int stat_socket_backlog_max_bytes;
+int stat_socket_backlog_full;
+
+int stat_bridge_packets;
+int stat_bridge_bytes;
+uint64_t stat_bridge_latency_total_us;
+int stat_bridge_latency_max_us;
+int stat_bridge_holds;
+uint64_t stat_bridge_hold_time_us;
+int stat_bridge_hold_max_us;
+int stat_bridge_writes_refused;
+int stat_bridge_fanout_drops;
+
+int stat_uart_rx_stalls;
+uint64_t stat_uart_rx_stall_time_us;
+int stat_uart_rx_stall_max_us;
 
 int stat_update_uart;
 int stat_update_longop;
@@ -222,6 +242,8 @@ irom void stats_time(string_t *dst)
 
 irom void stats_counters(string_t *dst)
 {
+	unsigned int uptime;
+
 	string_format(dst,
 			"> user_rf_cal_sector_set called: %s\n"
 			"> user_rf_pre_init called: %s\n"
@@ -240,9 +262,15 @@ irom void stats_counters(string_t *dst)
 			"> ntp updated: %u\n"
 			"> background idle: %u\n"
 			"> cmd receive buffer overflow events: %u\n"
+			"> cmd receive rejected packets: %u\n"
 			"> cmd send buffer overflow events: %u\n"
 			"> uart receive buffer overflow events: %u\n"
-			"> uart send buffer overflow events: %u\n",
+			"> uart send buffer overflow events: %u\n"
+			"> uart receive queue dropped bytes: %u\n"
+			"> uart send queue dropped bytes: %u\n"
+			"> socket lookups by port: %u\n"
+			"> socket backlog high watermark: %u entries, %u bytes\n"
+			"> socket backlog full events: %u\n",
 				yesno(stat_called.user_rf_cal_sector_set),
 				yesno(stat_called.user_rf_pre_init),
 				stat_uart_rx_interrupts,
@@ -260,9 +288,48 @@ irom void stats_counters(string_t *dst)
 				stat_update_ntp,
 				stat_update_idle,
 				stat_cmd_receive_buffer_overflow,
+				stat_cmd_receive_rejected,
 				stat_cmd_send_buffer_overflow,
 				stat_uart_receive_buffer_overflow,
-				stat_uart_send_buffer_overflow);
+				stat_uart_send_buffer_overflow,
+				queue_overflow(&uart_receive_queue),
+				queue_overflow(&uart_send_queue),
+				stat_socket_slow_lookups,
+				stat_socket_backlog_max_entries,
+				stat_socket_backlog_max_bytes,
+				stat_socket_backlog_full);
+
+	uptime = time_uptime_seconds();
+
+	string_format(dst,
+			"> bridge packets sent: %u\n"
+			"> bridge bytes sent: %u\n"
+			"> bridge packets per second: %u\n"
+			"> bridge average packet size: %u\n"
+			"> bridge average latency: %u us\n"
+			"> bridge maximum latency: %u us\n"
+			"> bridge tcp receive holds: %u\n"
+			"> bridge tcp total hold time: %u ms\n"
+			"> bridge tcp longest hold: %u us\n"
+			"> bridge writes refused: %u\n"
+			"> bridge packets not sent to a client: %u\n"
+			"> uart receive stalls: %u\n"
+			"> uart total receive stall time: %u ms\n"
+			"> uart longest receive stall: %u us\n",
+				stat_bridge_packets,
+				stat_bridge_bytes,
+				uptime > 0 ? stat_bridge_packets / uptime : 0,
+				stat_bridge_packets > 0 ? stat_bridge_bytes / stat_bridge_packets : 0,
+				stat_bridge_packets > 0 ? (unsigned int)(stat_bridge_latency_total_us / stat_bridge_packets) : 0,
+				stat_bridge_latency_max_us,
+				stat_bridge_holds,
+				(unsigned int)(stat_bridge_hold_time_us / 1000),
+				stat_bridge_hold_max_us,
+				stat_bridge_writes_refused,
+				stat_bridge_fanout_drops,
+				stat_uart_rx_stalls,
+				(unsigned int)(stat_uart_rx_stall_time_us / 1000),
+				stat_uart_rx_stall_max_us);
 }
 
 irom void stats_i2c(string_t *dst)
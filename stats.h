@@ -29,9 +29,28 @@ extern int stat_pc_counts;
 extern int stat_i2c_init_time_us;
 extern int stat_display_init_time_us;
 extern int stat_cmd_receive_buffer_overflow;
+extern int stat_cmd_receive_rejected;
 extern int stat_cmd_send_buffer_overflow;
 extern int stat_uart_receive_buffer_overflow;
 extern int stat_uart_send_buffer_overflow;
+extern int stat_socket_slow_lookups;
+extern int stat_socket_backlog_max_entries;
+extern int stat_socket_backlog_max_bytes;
+extern int stat_socket_backlog_full;
+
+extern int stat_bridge_packets;
+extern int stat_bridge_bytes;
+extern uint64_t stat_bridge_latency_total_us;
+extern int stat_bridge_latency_max_us;
+extern int stat_bridge_holds;
+extern uint64_t stat_bridge_hold_time_us;
+extern int stat_bridge_hold_max_us;
+extern int stat_bridge_writes_refused;
+extern int stat_bridge_fanout_drops;
+
+extern int stat_uart_rx_stalls;
+extern uint64_t stat_uart_rx_stall_time_us;
+extern int stat_uart_rx_stall_max_us;
 
 extern int stat_update_uart;
 extern int stat_update_longop;
@@ -75,6 +75,15 @@ irom string_t *time_uptime_stats(void)
 	return(sms_to_date(secs, msecs, raw1, raw2, base, wraps));
 }
 
+irom unsigned int time_uptime_seconds(void)
+{
+	unsigned int secs;
+
+	uptime_get(&secs, (unsigned int *)0, (unsigned int *)0, (unsigned int *)0, (unsigned int *)0, (unsigned int *)0);
+
+	return(secs);
+}
+
 // system
 
 static unsigned int system_last_us;
@@ -285,7 +294,6 @@ irom void time_ntp_init(void)
 	int ix;
 	int byte;
 	string_init(varname_ntp_server, "ntp.server.%u");
-	string_init(varname_ntp_tz, "ntp.tz");
 
 	sntp_stop();
 
@@ -305,8 +313,7 @@ irom void time_ntp_init(void)
 			ntp_server.byte[ix] = 0;
 	}
 
-	if(!config_get_int(&varname_ntp_tz, -1, -1, &ntp_timezone))
-		ntp_timezone = 0;
+	ntp_timezone = config_int(config_id_ntp_tz);
 
 	sntp_setserver(0, &ntp_server.ip_addr);
 	sntp_set_timezone(ntp_timezone);
@@ -4,6 +4,7 @@
 #include <util.h>
 
 string_t *time_uptime_stats(void);
+unsigned int time_uptime_seconds(void);
 string_t *time_system_stats(void);
 string_t *time_rtc_stats(void);
 string_t *time_timer_stats(void);
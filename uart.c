@@ -59,6 +59,153 @@ irom void uart_parameters_to_string(string_t *dst, const uart_parameters_t *para
 			params->stop_bits);
 }
 
+enum
+{
+	uart_fifo_size = 128,
+	uart_fifo_max_latency_ms = 4,
+	uart_fifo_busy_interrupts = 100,	// per 100 ms period = 1 kHz
+	uart_fifo_idle_interrupts = 10,		// per 100 ms period = 100 Hz
+	uart_fifo_rts_threshold = 112,		// deassert RTS when the fifo holds this many bytes
+};
+
+static struct
+{
+	int				bytes_per_ms;
+	int				rx_full;
+	int				rx_full_base;
+	int				rx_full_max;
+	int				rx_timeout;
+	int				tx_empty;
+	bool_t			rx_full_fixed;
+	unsigned int	last_interrupts;
+} uart_fifo;
+
+static struct
+{
+	bool_t					enabled;
+	volatile bool_t			rx_paused;
+	volatile uint32_t		rx_paused_since;
+	volatile bool_t			tx_wakeup;
+} uart_flow =
+{
+	.enabled = false,
+	.rx_paused = false,
+	.rx_paused_since = 0,
+	.tx_wakeup = false,
+};
+
+/*
+ * Idle gap framing: the receive fifo "timeout" interrupt fires when the line
+ * has been idle for the configured amount of character times. At that
+ * moment the interrupt handler records the current end of the receive
+ * queue as a frame boundary, in a small single producer / single consumer
+ * ring of its own. To make sure the timeout interrupt can fire at all, the
+ * fifo is never completely drained on a fifo "full" interrupt.
+ */
+
+enum
+{
+	uart_frames_size = 16,
+};
+
+static struct
+{
+	bool_t					idle;
+	volatile unsigned int	end[uart_frames_size];
+	volatile unsigned int	in;
+	volatile unsigned int	out;
+	unsigned int			last_end;
+	volatile unsigned int	overflow;
+} uart_frames =
+{
+	.idle = false,
+	.in = 0,
+	.out = 0,
+	.last_end = 0,
+	.overflow = 0,
+};
+
+/*
+ * Arrival times: for every batch of data the interrupt handler takes from
+ * the receive fifo it records the queue position of the batch's first byte
+ * and the time, in a ring like the frame boundaries. When the ring is full,
+ * a batch is accounted to the one before it.
+ */
+
+enum
+{
+	uart_rx_stamps_size = 8,
+};
+
+static struct
+{
+	volatile unsigned int	start[uart_rx_stamps_size];
+	volatile uint32_t		time[uart_rx_stamps_size];
+	volatile unsigned int	in;
+	volatile unsigned int	out;
+} uart_rx_stamps =
+{
+	.in = 0,
+	.out = 0,
+};
+
+static volatile unsigned int uart_rx_bytes;
+
+always_inline static int clamp(int value, int min, int max)
+{
+	if(value < min)
+		return(min);
+
+	if(value > max)
+		return(max);
+
+	return(value);
+}
+
+attr_speed iram static void uart_fifo_write_thresholds(void)
+{
+	uint32_t flow;
+
+	if(uart_flow.enabled)
+		flow = ((uart_fifo_rts_threshold & UART_RX_FLOW_THRHD) << UART_RX_FLOW_THRHD_S) | UART_RX_FLOW_EN;
+	else
+		flow = 0;
+
+	write_peri_reg(UART_CONF1(0),
+			((uart_fifo.rx_timeout & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN |
+			((uart_fifo.rx_full & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
+			((uart_fifo.tx_empty & UART_TXFIFO_EMPTY_THRHD) << UART_TXFIFO_EMPTY_THRHD_S) |
+			flow);
+}
+
+// Derive the fifo thresholds from the amount of bytes the uart can
+// receive per millisecond at the configured baud rate and frame format.
+//
+// - receive fifo "full" threshold: about 2 ms of data, so at low speed
+//   every byte is handled immediately and at high speed there's still
+//   plenty of room in the fifo for the interrupt latency. The periodic
+//   adjustment may raise it up to uart_fifo_max_latency_ms of data.
+// - receive fifo "timeout" threshold: a quarter ms of idle line, but at
+//   least 2 byte times, so small gaps in a stream don't trigger interrupts.
+// - transmit fifo "empty" threshold: a quarter ms of data left in the
+//   fifo when refilling, enough to cover the interrupt latency.
+
+irom static void uart_fifo_init(int baud, int data_bits, int stop_bits, uart_parity_t parity)
+{
+	int bits;
+
+	bits = 1 + data_bits + stop_bits + ((parity == parity_none) ? 0 : 1);
+
+	uart_fifo.bytes_per_ms = baud / (bits * 1000);
+	uart_fifo.rx_full_base = clamp(uart_fifo.bytes_per_ms * 2, 1, uart_fifo_size - 32);
+	uart_fifo.rx_full_max = clamp(uart_fifo.bytes_per_ms * uart_fifo_max_latency_ms, uart_fifo.rx_full_base, uart_fifo_size - 32);
+	uart_fifo.rx_full = uart_fifo.rx_full_base;
+	uart_fifo.rx_timeout = clamp(uart_fifo.bytes_per_ms / 4, 2, UART_RX_TOUT_THRHD);
+	uart_fifo.tx_empty = clamp(uart_fifo.bytes_per_ms / 4, 8, uart_fifo_size / 2);
+	uart_fifo.rx_full_fixed = false;
+	uart_fifo.last_interrupts = 0;
+}
+
 attr_speed iram static int uart_rx_fifo_length(void)
 {
 	return((read_peri_reg(UART_STATUS(0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT);
@@ -69,27 +216,89 @@ attr_speed iram static int uart_tx_fifo_length(void)
 	return((read_peri_reg(UART_STATUS(0)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
 }
 
+always_inline static void uart_tx_interrupt(int uart, bool_t enable)
+{
+	if(enable)
+		set_peri_reg_mask(UART_INT_ENA(uart), UART_TXFIFO_EMPTY_INT_ENA);
+	else
+		clear_peri_reg_mask(UART_INT_ENA(uart), UART_TXFIFO_EMPTY_INT_ENA);
+}
+
+attr_speed iram static int uart1_tx_fifo_length(void)
+{
+	return((read_peri_reg(UART_STATUS(1)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
+}
+
+/*
+ * The interrupt handler is the producer of uart_receive_queue and the
+ * consumer of uart_send_queue, task context has the opposite roles. Both
+ * queues are lock-free single producer / single consumer, so there is no
+ * need to mask the uart interrupt while handling it.
+ *
+ * With flow control enabled, the handler stops draining the receive fifo
+ * when the receive queue is full and masks the receive interrupts. The
+ * fifo then fills up and the uart deasserts RTS, which stops the sender.
+ * uart_rx_resume() is called by the consumer after it has freed up space.
+ *
+ * Both uarts share the interrupt. Uart 1 only has a transmitter, it's fed
+ * from uart1_send_queue and only used for logging.
+ */
+
 attr_speed iram static void uart_callback(void *p)
 {
-	char data;
+	uint32_t status;
+	unsigned int first;
+	int leave;
 
-	ETS_UART_INTR_DISABLE();
+	status = read_peri_reg(UART_INT_ST(0));
 
 	// receive fifo "timeout" or "full" -> data available
 
-	if(read_peri_reg(UART_INT_ST(0)) & (UART_RXFIFO_TOUT_INT_ST | UART_RXFIFO_FULL_INT_ST))
+	if(status & (UART_RXFIFO_TOUT_INT_ST | UART_RXFIFO_FULL_INT_ST))
 	{
 		stat_uart_rx_interrupts++;
 
 		// make sure to fetch all data from the fifo, or we'll get a another
-		// interrupt immediately after we enable it
+		// interrupt immediately after we enable it, data that doesn't fit
+		// is dropped and counted by the queue
+		// when framing on idle gaps, leave one byte on "full" so the
+		// "timeout" interrupt will still fire at the end of the frame
 
-		while(uart_rx_fifo_length() > 0)
+		leave = (uart_frames.idle && !(status & UART_RXFIFO_TOUT_INT_ST)) ? 1 : 0;
+		first = uart_receive_queue.in;
+
+		while(uart_rx_fifo_length() > leave)
 		{
-			data = read_peri_reg(UART_FIFO(0));
+			if(uart_flow.enabled && queue_full(&uart_receive_queue))
+			{
+				clear_peri_reg_mask(UART_INT_ENA(0), UART_RXFIFO_TOUT_INT_ENA | UART_RXFIFO_FULL_INT_ENA);
+				uart_flow.rx_paused_since = system_get_time();
+				uart_flow.rx_paused = true;
+				stat_uart_rx_stalls++;
+				break;
+			}
+
+			queue_push(&uart_receive_queue, read_peri_reg(UART_FIFO(0)));
+			uart_rx_bytes++;
+		}
 
-			if(!queue_full(&uart_receive_queue))
-				queue_push(&uart_receive_queue, data);
+		if((uart_receive_queue.in != first) && ((uart_rx_stamps.in - uart_rx_stamps.out) < uart_rx_stamps_size))
+		{
+			uart_rx_stamps.start[uart_rx_stamps.in % uart_rx_stamps_size] = first;
+			uart_rx_stamps.time[uart_rx_stamps.in % uart_rx_stamps_size] = system_get_time();
+			uart_rx_stamps.in++;
+		}
+
+		if(uart_frames.idle && (status & UART_RXFIFO_TOUT_INT_ST) && (uart_receive_queue.in != uart_frames.last_end))
+		{
+			if((uart_frames.in - uart_frames.out) < uart_frames_size)
+			{
+				uart_frames.end[uart_frames.in % uart_frames_size] = uart_receive_queue.in;
+				uart_frames.last_end = uart_receive_queue.in;
+				uart_frames.in++;
+			}
+			else
+				uart_frames.overflow++; // frame will be merged with the next one
 		}
 
 		system_os_post(background_task_id, 0, 0);
@@ -97,20 +306,39 @@ attr_speed iram static void uart_callback(void *p)
 
 	// receive transmit fifo "empty", room for new data in the fifo
 
-	if(read_peri_reg(UART_INT_ST(0)) & UART_TXFIFO_EMPTY_INT_ST)
+	if(status & UART_TXFIFO_EMPTY_INT_ST)
 	{
 		stat_uart_tx_interrupts++;
 
-		while(!queue_empty(&uart_send_queue) && (uart_tx_fifo_length() < 64))
+		while(!queue_empty(&uart_send_queue) && (uart_tx_fifo_length() < uart_fifo_size))
 			write_peri_reg(UART_FIFO(0), queue_pop(&uart_send_queue));
 
-		uart_start_transmit(!queue_empty(&uart_send_queue));
+		uart_tx_interrupt(0, !queue_empty(&uart_send_queue));
+
+		if(uart_flow.tx_wakeup && (queue_length(&uart_send_queue) <= (uart_send_queue_size / 4)))
+		{
+			uart_flow.tx_wakeup = false;
+			system_os_post(background_task_id, 0, 0);
+		}
 	}
 
-	// acknowledge all uart interrupts
+	// acknowledge the uart interrupts handled
 
-	write_peri_reg(UART_INT_CLR(0), 0xffff);
-	ETS_UART_INTR_ENABLE();
+	write_peri_reg(UART_INT_CLR(0), status);
+
+	// uart 1 transmit fifo "empty"
+
+	status = read_peri_reg(UART_INT_ST(1));
+
+	if(status & UART_TXFIFO_EMPTY_INT_ST)
+	{
+		while(!queue_empty(&uart1_send_queue) && (uart1_tx_fifo_length() < uart_fifo_size))
+			write_peri_reg(UART_FIFO(1), queue_pop(&uart1_send_queue));
+
+		uart_tx_interrupt(1, !queue_empty(&uart1_send_queue));
+	}
+
+	write_peri_reg(UART_INT_CLR(1), status);
 }
 
 irom void uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity)
@@ -158,10 +386,10 @@ irom void uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity
 	// something in it that should be written to the uart's fifo, see
 	// uart_start_transmit().
 
-	write_peri_reg(UART_CONF1(0),
-			(( 2 & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN |
-			((16 & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
-			((64 & UART_TXFIFO_EMPTY_THRHD) << UART_TXFIFO_EMPTY_THRHD_S));
+	// All thresholds depend on the baud rate, see uart_fifo_init().
+
+	uart_fifo_init(baud, data_bits, stop_bits, parity);
+	uart_fifo_write_thresholds();
 
 	write_peri_reg(UART_INT_CLR(0), 0xffff);
 	write_peri_reg(UART_INT_ENA(0), UART_RXFIFO_TOUT_INT_ENA | UART_RXFIFO_FULL_INT_ENA);
@@ -169,10 +397,225 @@ irom void uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity
 	ETS_UART_INTR_ENABLE();
 }
 
+// called from task context only, the read-modify-write of the interrupt
+// enable register must not race with the interrupt handler
+
 attr_speed iram void uart_start_transmit(char c)
 {
-	if(c)
-		set_peri_reg_mask(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
+	ETS_UART_INTR_DISABLE();
+	uart_tx_interrupt(0, c);
+	ETS_UART_INTR_ENABLE();
+}
+
+attr_speed iram void uart1_start_transmit(char c)
+{
+	ETS_UART_INTR_DISABLE();
+	uart_tx_interrupt(1, c);
+	ETS_UART_INTR_ENABLE();
+}
+
+// Uart 1 is transmit only, its TX signal is available on gpio 2 when it's
+// set to uart mode. It's fixed at 115200 baud 8N1 and used for logging.
+
+irom void uart1_init(void)
+{
+	ETS_UART_INTR_DISABLE();
+
+	write_peri_reg(UART_CLKDIV(1), UART_CLK_FREQ / 115200);
+
+	write_peri_reg(UART_CONF0(1),
+			(((8 - 5) & UART_BIT_NUM) << UART_BIT_NUM_S) |
+			((0x01 & UART_STOP_BIT_NUM) << UART_STOP_BIT_NUM_S));
+
+	set_peri_reg_mask(UART_CONF0(1), UART_RXFIFO_RST | UART_TXFIFO_RST);
+	clear_peri_reg_mask(UART_CONF0(1), UART_RXFIFO_RST | UART_TXFIFO_RST);
+
+	write_peri_reg(UART_CONF1(1), ((32 & UART_TXFIFO_EMPTY_THRHD) << UART_TXFIFO_EMPTY_THRHD_S));
+
+	write_peri_reg(UART_INT_CLR(1), 0xffff);
+	write_peri_reg(UART_INT_ENA(1), 0);
+
+	ETS_UART_INTR_ENABLE();
+}
+
+// Override the computed fifo thresholds, -1 means keep the computed value.
+// A fixed receive fifo "full" threshold disables the periodic adjustment.
+
+irom void uart_fifo_thresholds(int rx_full, int rx_timeout, int tx_empty)
+{
+	if(rx_full > 0)
+	{
+		uart_fifo.rx_full = clamp(rx_full, 1, uart_fifo_size - 1);
+		uart_fifo.rx_full_fixed = true;
+	}
+
+	if(rx_timeout > 0)
+		uart_fifo.rx_timeout = clamp(rx_timeout, 1, UART_RX_TOUT_THRHD);
+
+	if(tx_empty > 0)
+		uart_fifo.tx_empty = clamp(tx_empty, 1, uart_fifo_size - 1);
+
+	uart_fifo_write_thresholds();
+}
+
+// Called every 100 ms. When the receive interrupt rate is high, raise the
+// "full" threshold (fewer interrupts per kilobyte), up to the latency
+// bound. When the rate drops, step back towards the base value.
+
+iram attr_speed void uart_periodic(void)
+{
+	unsigned int interrupts;
+	int rx_full;
+
+	interrupts = stat_uart_rx_interrupts - uart_fifo.last_interrupts;
+	uart_fifo.last_interrupts = stat_uart_rx_interrupts;
+
+	if(uart_fifo.rx_full_fixed)
+		return;
+
+	rx_full = uart_fifo.rx_full;
+
+	if(interrupts > uart_fifo_busy_interrupts)
+		rx_full = clamp(rx_full * 2, uart_fifo.rx_full_base, uart_fifo.rx_full_max);
+	else
+		if(interrupts < uart_fifo_idle_interrupts)
+			rx_full = clamp(rx_full / 2, uart_fifo.rx_full_base, uart_fifo.rx_full_max);
+
+	if(rx_full != uart_fifo.rx_full)
+	{
+		uart_fifo.rx_full = rx_full;
+		uart_fifo_write_thresholds();
+	}
+}
+
+irom void uart_fifo_to_string(string_t *dst)
+{
+	string_format(dst, "rx full: %d (%s, %d-%d), rx timeout: %d, tx empty: %d, rx bytes: %u, rx interrupts: %u",
+			uart_fifo.rx_full, uart_fifo.rx_full_fixed ? "fixed" : "adaptive",
+			uart_fifo.rx_full_base, uart_fifo.rx_full_max,
+			uart_fifo.rx_timeout, uart_fifo.tx_empty,
+			uart_rx_bytes, stat_uart_rx_interrupts);
+}
+
+// Enable or disable hardware flow control. The uart's RTS and CTS signals
+// appear on gpio 15 and gpio 13 when these are set to uart mode.
+
+irom void uart_flow_control(bool_t enable)
+{
+	uart_flow.enabled = enable;
+
+	if(enable)
+		set_peri_reg_mask(UART_CONF0(0), UART_TX_FLOW_EN);
 	else
-		clear_peri_reg_mask(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
+		clear_peri_reg_mask(UART_CONF0(0), UART_TX_FLOW_EN);
+
+	uart_fifo_write_thresholds();
+}
+
+// Called by the consumer of the receive queue after it freed up space,
+// restarts reception if the interrupt handler stopped it.
+
+attr_speed iram void uart_rx_resume(void)
+{
+	uint32_t stalled;
+
+	if(!uart_flow.rx_paused || (queue_space(&uart_receive_queue) < uart_fifo_size))
+		return;
+
+	stalled = system_get_time() - uart_flow.rx_paused_since;
+	stat_uart_rx_stall_time_us += stalled;
+
+	if((int)stalled > stat_uart_rx_stall_max_us)
+		stat_uart_rx_stall_max_us = stalled;
+
+	uart_flow.rx_paused = false;
+
+	ETS_UART_INTR_DISABLE();
+	set_peri_reg_mask(UART_INT_ENA(0), UART_RXFIFO_TOUT_INT_ENA | UART_RXFIFO_FULL_INT_ENA);
+	ETS_UART_INTR_ENABLE();
+}
+
+// Ask the interrupt handler to post the background task when the send queue
+// has drained below a quarter of its size.
+
+attr_speed iram void uart_tx_wakeup(void)
+{
+	uart_flow.tx_wakeup = true;
+}
+
+irom void uart_flow_to_string(string_t *dst)
+{
+	string_format(dst, "flow control: %s, rx paused: %s, rx stalls: %u, total stall time: %u ms, longest stall: %u us",
+			onoff(uart_flow.enabled), yesno(uart_flow.rx_paused),
+			stat_uart_rx_stalls, (unsigned int)(stat_uart_rx_stall_time_us / 1000), stat_uart_rx_stall_max_us);
+}
+
+// Enable or disable framing on idle gaps of gap character times.
+
+irom void uart_rx_framing(bool_t idle, int gap)
+{
+	uart_frames.idle = idle;
+	uart_frames.in = uart_frames.out = 0;
+	uart_frames.last_end = uart_receive_queue.in;
+
+	if(idle)
+	{
+		uart_fifo.rx_timeout = clamp(gap, 1, UART_RX_TOUT_THRHD);
+
+		// at least two bytes, because one byte is always left in the fifo
+
+		if(uart_fifo.rx_full_base < 2)
+			uart_fifo.rx_full_base = 2;
+
+		if(uart_fifo.rx_full_max < uart_fifo.rx_full_base)
+			uart_fifo.rx_full_max = uart_fifo.rx_full_base;
+
+		if(uart_fifo.rx_full < 2)
+			uart_fifo.rx_full = 2;
+	}
+
+	uart_fifo_write_thresholds();
+}
+
+// Return the length of the first complete frame in the receive queue,
+// 0 if there is none. Boundaries the consumer has already passed are
+// dropped, so a frame is released by simply removing it from the queue.
+
+// Return the time the oldest byte in the receive queue arrived, or now
+// when it's empty. Stamps of batches that have been removed completely
+// are dropped.
+
+attr_speed iram uint32_t uart_rx_arrival(void)
+{
+	unsigned int out = uart_receive_queue.out;
+
+	while((uart_rx_stamps.in - uart_rx_stamps.out) > 1)
+	{
+		if((int)(uart_rx_stamps.start[(uart_rx_stamps.out + 1) % uart_rx_stamps_size] - out) > 0)
+			break;
+
+		uart_rx_stamps.out++;
+	}
+
+	if((uart_rx_stamps.in == uart_rx_stamps.out) || queue_empty(&uart_receive_queue))
+		return(system_get_time());
+
+	return(uart_rx_stamps.time[uart_rx_stamps.out % uart_rx_stamps_size]);
+}
+
+attr_speed iram int uart_rx_frame_length(void)
+{
+	int length;
+
+	while(uart_frames.in != uart_frames.out)
+	{
+		length = uart_frames.end[uart_frames.out % uart_frames_size] - uart_receive_queue.out;
+
+		if(length > 0)
+			return(length);
+
+		uart_frames.out++;
+	}
+
+	return(0);
 }
@@ -29,5 +29,17 @@ uart_parity_t	uart_string_to_parity(const string_t *src);
 void			uart_parameters_to_string(string_t *dst, const uart_parameters_t *);
 void			uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity);
 void			uart_start_transmit(char);
+void			uart1_init(void);
+void			uart1_start_transmit(char);
+void			uart_fifo_thresholds(int rx_full, int rx_timeout, int tx_empty);
+void			uart_fifo_to_string(string_t *dst);
+void			uart_periodic(void);
+void			uart_flow_control(bool_t enable);
+void			uart_flow_to_string(string_t *dst);
+void			uart_rx_resume(void);
+void			uart_tx_wakeup(void);
+void			uart_rx_framing(bool_t idle, int gap);
+int				uart_rx_frame_length(void);
+uint32_t		uart_rx_arrival(void);
 
 #endif
@@ -9,6 +9,7 @@
 #include "time.h"
 #include "i2c_sensor.h"
 #include "socket.h"
+#include "binary.h"
 
 #if IMAGE_OTA == 1
 #include <rboot-api.h>
@@ -16,11 +17,24 @@
 
 typedef enum
 {
-	ts_copy,
-	ts_dodont,
-	ts_data,
+	ts_copy,		// plain data
+	ts_iac,			// after IAC
+	ts_option,		// after IAC WILL/WONT/DO/DONT, expecting the option byte
+	ts_sb,			// inside IAC SB ... IAC SE subnegotiation
+	ts_sb_iac,		// after IAC inside subnegotiation
 } telnet_strip_state_t;
 
+enum
+{
+	telnet_se = 240,
+	telnet_sb = 250,
+	telnet_will = 251,
+	telnet_wont = 252,
+	telnet_do = 253,
+	telnet_dont = 254,
+	telnet_iac = 255,
+};
+
 typedef enum
 {
 	reset_state_inactive,
@@ -38,6 +52,9 @@ typedef enum
 	socket_state_received,
 	socket_state_processing,
 	socket_state_sending,
+	socket_state_send_wait,
+	socket_state_generate_wait,
+	socket_state_generate,
 } socket_state_t;
 
 _Static_assert(sizeof(telnet_strip_state_t) == 4, "sizeof(telnet_strip_state) != 4");
@@ -54,6 +71,58 @@ typedef struct
 
 static char _socket_cmd_send_buffer[4096 + 8];
 
+// replies are copied into the backlog, so the send buffer is free for the
+// next command while the previous reply hasn't been acknowledged yet
+
+static char _socket_cmd_backlog_buffer[sizeof(_socket_cmd_send_buffer)];
+
+// commands are collected in the input queue and split into lines, see
+// background_task_command_handler(); the tcp peer is held when the queue
+// has less space than a full segment
+
+enum
+{
+	cmd_receive_queue_size = 2048,
+	cmd_line_size = 512,
+	cmd_hold_space = 1460,
+	cmd_partial_line_timeout_ms = 20,
+};
+
+static char _cmd_receive_queue_buffer[cmd_receive_queue_size];
+static char _cmd_line_buffer[cmd_line_size];
+
+static queue_t cmd_receive_queue;
+
+static string_t cmd_line =
+{
+	.length = 0,
+	.size = sizeof(_cmd_line_buffer),
+	.buffer = _cmd_line_buffer
+};
+
+// tcp and udp input share the queue, so while there is queued input or a
+// command is running only the sender of that input is accepted, its replies
+// go back to it
+
+static struct
+{
+	bool_t			held;
+	bool_t			timer_armed;
+	uint32_t		last_received;
+	socket_remote_t	remote;
+} cmd_input =
+{
+	.held = false,
+	.timer_armed = false,
+	.last_received = 0,
+	.remote =
+	{
+		.proto = proto_none,
+		.child = -1,
+		.port = 0,
+	},
+};
+
 static socket_data_t socket_cmd =
 {
 	.state = socket_state_idle,
@@ -71,7 +140,8 @@ static socket_data_t socket_cmd =
 	}
 };
 
-static char _socket_uart_send_buffer[1024];
+// the uart bridge send buffer has no storage of its own, it's a view on
+// the data in uart_receive_queue, which is released when it has been sent
 
 static socket_data_t socket_uart =
 {
@@ -86,8 +156,8 @@ static socket_data_t socket_uart =
 	.send_buffer =
 	{
 		.length = 0,
-		.size = sizeof(_socket_uart_send_buffer),
-		.buffer = _socket_uart_send_buffer
+		.size = 0,
+		.buffer = (char *)0
 	}
 };
 
@@ -97,20 +167,118 @@ static reset_state_t reset_state = reset_state_inactive;
 static struct
 {
 	unsigned int disconnect:1;
+	unsigned int disconnect_when_sent:1;
 	unsigned int init_i2c_sensors:1;
 	unsigned int init_displays:1;
 } bg_action =
 {
 	.disconnect = 0,
+	.disconnect_when_sent = 0,
 	.init_i2c_sensors = 0,
 	.init_displays = 0,
 };
 
+// the coalescing window and the latency stats count from the arrival of
+// the oldest byte that hasn't been sent yet
+
+static struct
+{
+	int			bytes;
+	int			time_us;
+	bool_t		timer_armed;
+} bridge_coalesce =
+{
+	.bytes = 0,
+	.time_us = 0,
+	.timer_armed = false,
+};
+
+// a frame that wraps around the end of the receive queue is copied into the
+// bounce buffer, so it can still be sent as one packet, it must hold the
+// largest frame that is sent, otherwise a wrapped frame would be split
+
+enum
+{
+	bridge_frame_bounce_size = uart_bridge_max_send_length,
+};
+
+static struct
+{
+	bridge_framing_t	mode;
+	int					gap;
+	char				delimiter;
+	char				bounce[bridge_frame_bounce_size];
+} bridge_framing =
+{
+	.mode = bridge_framing_none,
+	.gap = 4,
+	.delimiter = '\n',
+};
+
+// hold the tcp peer when the uart send queue has less space than one full
+// segment, release it when the queue has drained to a quarter
+
+enum
+{
+	bridge_hold_space = 1460,
+	bridge_unhold_length = uart_send_queue_size / 4,
+};
+
+_Static_assert(bridge_hold_space < uart_send_queue_size - bridge_unhold_length, "uart send queue too small for flow control");
+_Static_assert((bridge_framing_none == 0) && (bridge_writers_first == 0), "config registry defaults for bridge.framing.mode and bridge.writers");
+
+static struct
+{
+	bool_t		held;
+	uint32_t	held_since;
+} bridge_flow =
+{
+	.held = false,
+	.held_since = 0,
+};
+
+// every tcp client has a slot, the udp peer uses the last one; a slot's bit
+// in pending is a reference to the span that's currently being sent; the
+// udp peer is the last host that sent a datagram, it gets the uart output
+// alongside the tcp clients
+
+enum
+{
+	bridge_client_udp = socket_max_children,
+	bridge_client_slots,
+};
+
+static struct
+{
+	bridge_writers_t		writers;
+	ip_addr_to_bytes_t		writer_ip;
+	int						writer;		// slot owning the uart with writers = first, -1 if none
+	unsigned int			pending;
+	bool_t					starting;	// bridge_send() is running, see callback_sent_uart()
+	socket_remote_t			udp_peer;
+	telnet_strip_state_t	telnet_state[bridge_client_slots]; // kept across packets, reset on connect
+} bridge_clients =
+{
+	.writers = bridge_writers_first,
+	.writer = -1,
+	.pending = 0,
+	.starting = false,
+	.udp_peer =
+	{
+		.proto = proto_none,
+		.child = -1,
+		.port = 0,
+	},
+};
+
 static ETSTimer fast_timer;
 static ETSTimer slow_timer;
+static ETSTimer bridge_coalesce_timer;
+static ETSTimer cmd_partial_line_timer;
 
 queue_t uart_send_queue;
 queue_t uart_receive_queue;
+queue_t uart1_send_queue;
 
 attr_const void user_spi_flash_dio_to_qio_pre_init(void);
 iram attr_const void user_spi_flash_dio_to_qio_pre_init(void)
@@ -135,27 +303,213 @@ iram void user_rf_pre_init(void)
 
 static void user_init2(void);
 
+always_inline static void bridge_uart_release(void)
+{
+	queue_skip(&uart_receive_queue, string_length(&socket_uart.send_buffer));
+	string_set(&socket_uart.send_buffer, (char *)0, 0, 0);
+	socket_uart.state = socket_state_idle;
+
+	uart_rx_resume();
+}
+
+always_inline static int bridge_client_slot(const socket_t *socket)
+{
+	return((socket->event_child < 0) ? bridge_client_udp : socket->event_child);
+}
+
+// drop a client's reference to the span being sent, release it after the last one
+
+always_inline static bool_t bridge_client_done(int slot)
+{
+	if(!(bridge_clients.pending & (1 << slot)))
+		return(false);
+
+	bridge_clients.pending &= ~(1 << slot);
+
+	if(bridge_clients.pending)
+		return(false);
+
+	bridge_uart_release();
+
+	return(true);
+}
+
+always_inline static void bridge_flow_unhold(void)
+{
+	uint32_t held;
+
+	if(!bridge_flow.held)
+		return;
+
+	held = system_get_time() - bridge_flow.held_since;
+	stat_bridge_hold_time_us += held;
+
+	if((int)held > stat_bridge_hold_max_us)
+		stat_bridge_hold_max_us = held;
+
+	bridge_flow.held = false;
+	socket_unhold(&socket_uart.socket);
+}
+
+always_inline static bool_t background_task_bridge_flow(void)
+{
+	if(bridge_flow.held && (queue_length(&uart_send_queue) <= bridge_unhold_length))
+	{
+		bridge_flow_unhold();
+		return(true);
+	}
+
+	return(false);
+}
+
+/*
+ * The receive queue is used as a ping-pong buffer: a send never takes more
+ * than half of the queue, so the uart interrupt handler always has at least
+ * the other half to fill while the send is in flight. As soon as a send
+ * completes, the next one is started from the sent callback.
+ *
+ * Data is held back until either bridge.coalesce.bytes bytes have been
+ * received or the oldest byte is bridge.coalesce.time microseconds old,
+ * whichever comes first. The bridge coalesce timer makes sure the data
+ * is sent when the time has passed and nothing else triggers the
+ * background task.
+ *
+ * With framing enabled, coalescing doesn't apply. Each packet contains
+ * exactly one frame, ended either by an idle gap on the line or by the
+ * delimiter byte. Incomplete frames are held back, unless they fill up
+ * the maximum packet size.
+ */
+
+always_inline static int bridge_frame_length(void)
+{
+	int length;
+
+	if(bridge_framing.mode == bridge_framing_idle)
+		length = uart_rx_frame_length();
+	else
+		length = queue_find(&uart_receive_queue, bridge_framing.delimiter);
+
+	if((length == 0) && (queue_length(&uart_receive_queue) >= uart_bridge_max_send_length))
+		length = uart_bridge_max_send_length;
+
+	return(length);
+}
+
+// The span is sent to all tcp clients and the udp peer from the same buffer,
+// a client the send fails for misses this span, the others aren't held up
+// by it. All
+// references are taken before the first send, as a send may complete (udp)
+// from within the send call. The span is released after the last reference
+// has gone, returns the number of clients it has been handed to.
+
+always_inline static int bridge_send(void)
+{
+	socket_t *socket = &socket_uart.socket;
+	unsigned int slots = 0;
+	int slot, sent = 0;
+
+	for(slot = 0; slot < socket_max_children; slot++)
+		if(socket_child_connected(socket, slot))
+			slots |= 1 << slot;
+
+	if(bridge_clients.udp_peer.proto == proto_udp)
+		slots |= 1 << bridge_client_udp;
+
+	if(!slots)
+	{
+		bridge_uart_release();
+		return(0);
+	}
+
+	bridge_clients.pending = slots;
+	bridge_clients.starting = true;
+
+	for(slot = 0; slot < bridge_client_slots; slot++)
+	{
+		if(!(slots & (1 << slot)))
+			continue;
+
+		if((slot == bridge_client_udp) ? socket_send_to(socket, &bridge_clients.udp_peer, &socket_uart.send_buffer) :
+				socket_send_child(socket, slot, &socket_uart.send_buffer))
+			sent++;
+		else
+		{
+			stat_bridge_fanout_drops++;
+			bridge_client_done(slot);
+		}
+	}
+
+	bridge_clients.starting = false;
+
+	return(sent);
+}
+
 always_inline static bool_t background_task_bridge_uart(void)
 {
+	char *span;
+	int length, frame_length;
+	uint32_t arrival, now, waiting;
+
 	if(socket_uart.state == socket_state_idle)
 	{
-		while(!queue_empty(&uart_receive_queue) && string_space(&socket_uart.send_buffer))
-			string_append_char(&socket_uart.send_buffer, queue_pop(&uart_receive_queue));
+		if(queue_empty(&uart_receive_queue))
+			return(false);
+
+		arrival = uart_rx_arrival();
+		now = system_get_time();
+		waiting = now - arrival;
 
-		if(!string_empty(&socket_uart.send_buffer))
+		if(bridge_framing.mode != bridge_framing_none)
 		{
-			socket_uart.state = socket_state_sending;
+			if((frame_length = bridge_frame_length()) == 0)
+				return(false);
 
-			if(socket_send(&socket_uart.socket, &socket_uart.send_buffer))
-				return(true);
-			else
+			if(frame_length > uart_bridge_max_send_length)
+				frame_length = uart_bridge_max_send_length;
+		}
+		else
+		{
+			frame_length = uart_bridge_max_send_length;
+
+			if((queue_length(&uart_receive_queue) < bridge_coalesce.bytes) && (waiting < (uint32_t)bridge_coalesce.time_us))
 			{
-				string_clear(&socket_uart.send_buffer);
-				socket_uart.state = socket_state_idle;
-				stat_uart_send_buffer_overflow++;
+				if(!bridge_coalesce.timer_armed)
+				{
+					bridge_coalesce.timer_armed = true;
+					os_timer_arm(&bridge_coalesce_timer, ((bridge_coalesce.time_us - waiting) + 999) / 1000, 0);
+				}
+
 				return(false);
 			}
 		}
+
+		if((length = queue_peek(&uart_receive_queue, &span)) > 0)
+		{
+			if(length > frame_length)
+				length = frame_length;
+
+			if((bridge_framing.mode != bridge_framing_none) && (length < frame_length))
+			{
+				length = queue_peek_n(&uart_receive_queue, frame_length, bridge_framing.bounce);
+				span = bridge_framing.bounce;
+			}
+
+			stat_bridge_packets++;
+			stat_bridge_bytes += length;
+			stat_bridge_latency_total_us += waiting;
+
+			if((int)waiting > stat_bridge_latency_max_us)
+				stat_bridge_latency_max_us = waiting;
+
+			string_set(&socket_uart.send_buffer, span, length, length);
+			socket_uart.state = socket_state_sending;
+
+			if(bridge_send() > 0)
+				return(true);
+
+			stat_uart_send_buffer_overflow++;
+			return(false);
+		}
 	}
 
 	return(false);
@@ -191,62 +545,198 @@ always_inline static bool_t background_task_longop_handler(void)
 	return(false);
 }
 
-always_inline static bool_t background_task_command_handler(void)
+// when the backlog is full the reply stays in the send buffer and it's
+// retried after the next sent callback, it's never dropped; when a command
+// has more output, the next chunk is made after this one has been sent
+
+always_inline static bool_t background_task_command_send(void)
 {
-	if(socket_cmd.state != socket_state_received)
+	socket_cmd.socket.remote = cmd_input.remote;
+
+	if(socket_send(&socket_cmd.socket, &socket_cmd.send_buffer))
+	{
+		socket_cmd.state = application_generating() ? socket_state_generate_wait : socket_state_idle;
+		return(true);
+	}
+
+	if(socket_send_pending(&socket_cmd.socket))
+	{
+		socket_cmd.state = socket_state_send_wait;
 		return(false);
+	}
+
+	stat_cmd_send_buffer_overflow++;
+	application_generate_cancel();
+	socket_cmd.state = socket_state_idle;
 
-	socket_cmd.state = socket_state_processing;
+	return(false);
+}
 
-	string_clear(&socket_cmd.send_buffer);
+// returns true when no further commands from the same batch should be run
 
-	switch(application_content(&socket_cmd.receive_buffer, &socket_cmd.send_buffer))
+always_inline static bool_t command_run(const string_t *src, string_t *dst, bool_t pipelined)
+{
+	switch(application_content(src, dst))
 	{
 		case(app_action_normal):
 		case(app_action_error):
-		case(app_action_http_ok):
 		{
 			/* no special action for now */
 			break;
 		}
+		case(app_action_http_ok):
+		{
+			// an http page has no length in its header, it ends when the connection is closed
+
+			if(cmd_input.remote.proto == proto_tcp)
+				bg_action.disconnect_when_sent = 1;
+
+			break;
+		}
 		case(app_action_empty):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> empty command\n");
+			string_clear(dst);
+
+			if(!pipelined) // blank lines between pipelined commands are ignored
+				string_append(dst, "> empty command\n");
+
 			break;
 		}
 		case(app_action_disconnect):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> disconnect\n");
+			string_clear(dst);
+			string_append(dst, "> disconnect\n");
 			bg_action.disconnect = 1;
-			break;
+			return(true);
 		}
 		case(app_action_reset):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> reset\n");
+			string_clear(dst);
+			string_append(dst, "> reset\n");
 			reset_state = reset_state_send_reply;
-			break;
+			return(true);
 		}
 		case(app_action_ota_commit):
 		{
 #if IMAGE_OTA == 1
 			rboot_config rcfg = rboot_get_config();
-			string_format(&socket_cmd.send_buffer, "OTA commit slot %d\n", rcfg.current_rom);
+			string_format(dst, "OTA commit slot %d\n", rcfg.current_rom);
 			reset_state = reset_state_send_reply;
 #endif
-			break;
+			return(true);
+		}
+		case(app_action_more):
+		{
+			// the rest of the output comes first, further commands wait
+
+			return(true);
 		}
 	}
 
-	socket_cmd.state = socket_state_sending;
+	return(false);
+}
 
-	if(!socket_send(&socket_cmd.socket, &socket_cmd.send_buffer))
+// A line is complete when its newline has arrived. When nothing more has
+// come in for a while, whatever is there is taken as a line too, so
+// clients that don't end their commands with a newline still work.
+
+always_inline static int command_line_length(void)
+{
+	int length;
+
+	if(queue_empty(&cmd_receive_queue))
+		return(0);
+
+	if((length = queue_find(&cmd_receive_queue, '\n')) > 0)
+		return(length);
+
+	if((system_get_time() - cmd_input.last_received) >= (cmd_partial_line_timeout_ms * 1000))
+		return(queue_length(&cmd_receive_queue));
+
+	if(!cmd_input.timer_armed)
 	{
-		stat_cmd_send_buffer_overflow++;
-		socket_cmd.state = socket_state_idle;
+		cmd_input.timer_armed = true;
+		os_timer_arm(&cmd_partial_line_timer, cmd_partial_line_timeout_ms, 0);
+	}
+
+	return(0);
+}
+
+always_inline static void command_line_pop(int length, string_t *line)
+{
+	int popped;
+
+	popped = queue_pop_n(&cmd_receive_queue, length < string_size(line) ? length : string_size(line), string_buffer_nonconst(line));
+	string_setlength(line, popped);
+
+	if(popped < length)
+	{
+		queue_skip(&cmd_receive_queue, length - popped);
+		stat_cmd_receive_buffer_overflow++;
+	}
+}
+
+/*
+ * Raw packets (binary data, http requests) are run as one command, as
+ * before. Lines from the command input queue are run back to back, each
+ * command gets the whole send buffer and its reply is handed to the send
+ * backlog right away. The backlog appends replies to the one that is
+ * waiting to be sent, so a batch still goes out in as few segments as
+ * possible. When the backlog is full, the remaining lines are run after
+ * the reply has been sent.
+ */
+
+always_inline static bool_t background_task_command_handler(void)
+{
+	int length;
+	bool_t stop;
+
+	if(socket_cmd.state == socket_state_send_wait)
+		return(background_task_command_send());
+
+	if(socket_cmd.state == socket_state_generate)
+	{
+		socket_cmd.state = socket_state_processing;
+		string_clear(&socket_cmd.send_buffer);
+		application_continue(&socket_cmd.send_buffer);
+
+		return(background_task_command_send());
+	}
+
+	if(socket_cmd.state == socket_state_received)
+	{
+		socket_cmd.state = socket_state_processing;
+		string_clear(&socket_cmd.send_buffer);
+		command_run(&socket_cmd.receive_buffer, &socket_cmd.send_buffer, false);
+
+		return(background_task_command_send());
+	}
+
+	if((socket_cmd.state != socket_state_idle) || ((length = command_line_length()) == 0))
 		return(false);
+
+	do
+	{
+		command_line_pop(length, &cmd_line);
+
+		socket_cmd.state = socket_state_processing;
+		string_clear(&socket_cmd.send_buffer);
+
+		stop = command_run(&cmd_line, &socket_cmd.send_buffer, true);
+
+		if(stop && !application_generating())
+			queue_flush(&cmd_receive_queue);
+
+		if(string_empty(&socket_cmd.send_buffer))
+			socket_cmd.state = socket_state_idle;
+		else
+			background_task_command_send();
+	} while(!stop && (socket_cmd.state == socket_state_idle) && ((length = command_line_length()) > 0));
+
+	if(cmd_input.held && (queue_space(&cmd_receive_queue) >= (cmd_receive_queue_size / 2)))
+	{
+		cmd_input.held = false;
+		socket_unhold(&socket_cmd.socket);
 	}
 
 	return(true);
@@ -257,7 +747,6 @@ iram attr_speed static void background_task(os_event_t *events) // posted every
 	stat_slow_timer++;
 	config_wlan_mode_t wlan_mode;
 	int wlan_mode_int;
-	string_init(varname_wlan_mode, "wlan.mode");
 
 	switch(reset_state)
 	{
@@ -283,6 +772,17 @@ iram attr_speed static void background_task(os_event_t *events) // posted every
 		default: break;
 	}
 
+	// a reply that couldn't be sent from the backlog earlier is tried again
+
+	socket_retry(&socket_cmd.socket);
+
+	if(uart_bridge_active && background_task_bridge_flow())
+	{
+		stat_update_uart++;
+		system_os_post(background_task_id, 0, 0);
+		return;
+	}
+
 	if(uart_bridge_active && background_task_bridge_uart())
 	{
 		stat_update_uart++;
@@ -319,16 +819,12 @@ iram attr_speed static void background_task(os_event_t *events) // posted every
 
 	if((wifi_station_get_connect_status() != STATION_GOT_IP) && (stat_update_idle == 300))
 	{
-		if(config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int))
-			wlan_mode = (config_wlan_mode_t)wlan_mode_int;
-		else
-			wlan_mode = config_wlan_mode_client;
+		wlan_mode_int = config_int(config_id_wlan_mode);
+		wlan_mode = (config_wlan_mode_t)wlan_mode_int;
 
 		if(wlan_mode == config_wlan_mode_client)
 		{
-			wlan_mode_int = (int)config_wlan_mode_ap;
-			config_set_int(&varname_wlan_mode, -1, -1, wlan_mode_int);
-			config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int);
+			config_set_int_id(config_id_wlan_mode, config_wlan_mode_ap);
 			wlan_init();
 		}
 	}
@@ -345,11 +841,26 @@ iram attr_speed static void fast_timer_callback(void *arg)
 	io_periodic();
 }
 
+iram attr_speed static void cmd_partial_line_timer_callback(void *arg)
+{
+	cmd_input.timer_armed = false;
+
+	system_os_post(background_task_id, 0, 0);
+}
+
+iram attr_speed static void bridge_coalesce_timer_callback(void *arg)
+{
+	bridge_coalesce.timer_armed = false;
+
+	system_os_post(background_task_id, 0, 0);
+}
+
 iram attr_speed static void slow_timer_callback(void *arg)
 {
 	// run background task every ~100 ms = ~10 Hz
 
 	time_periodic();
+	uart_periodic();
 
 	system_os_post(background_task_id, 0, 0);
 }
@@ -370,43 +881,39 @@ irom void user_init(void)
 		stat_stack_painted += 4;
 	}
 
-	static char uart_send_queue_buffer[1024];
-	static char uart_receive_queue_buffer[1024];
-
-	int uart_baud, uart_data, uart_stop, uart_parity_int;
-	uart_parity_t uart_parity;
+	static char uart_send_queue_buffer[uart_send_queue_size];
+	static char uart_receive_queue_buffer[uart_receive_queue_size];
+	static char uart1_send_queue_buffer[uart1_send_queue_size];
 
-	string_init(varname_uart_baud, "uart.baud");
-	string_init(varname_uart_data, "uart.data");
-	string_init(varname_uart_stop, "uart.stop");
-	string_init(varname_uart_parity, "uart.parity");
+	int uart_parity_int;
 
 	system_set_os_print(0);
 
 	queue_new(&uart_send_queue, sizeof(uart_send_queue_buffer), uart_send_queue_buffer);
 	queue_new(&uart_receive_queue, sizeof(uart_receive_queue_buffer), uart_receive_queue_buffer);
+	queue_new(&uart1_send_queue, sizeof(uart1_send_queue_buffer), uart1_send_queue_buffer);
+	queue_new(&cmd_receive_queue, sizeof(_cmd_receive_queue_buffer), _cmd_receive_queue_buffer);
 
 	bg_action.disconnect = 0;
+	bg_action.disconnect_when_sent = 0;
 	bg_action.init_i2c_sensors = 1;
 	bg_action.init_displays = 1;
 
-	config_read();
+	// the binary command protocol checks every frame's crc, the table
+	// isn't filled otherwise before the first config write or ota
 
-	if(!config_get_int(&varname_uart_baud, -1, -1, &uart_baud))
-		uart_baud = 115200;
+	string_crc32_init();
 
-	if(!config_get_int(&varname_uart_data, -1, -1, &uart_data))
-		uart_data = 8;
+	config_read();
 
-	if(!config_get_int(&varname_uart_stop, -1, -1, &uart_stop))
-		uart_stop = 1;
+	uart_parity_int = config_int(config_id_uart_parity);
 
-	if(config_get_int(&varname_uart_parity, -1, -1, &uart_parity_int))
-		uart_parity = (uart_parity_t)uart_parity_int;
-	else
-		uart_parity = parity_none;
+	uart_init(config_int(config_id_uart_baud), config_int(config_id_uart_bits), config_int(config_id_uart_stop),
+			(uart_parity_t)uart_parity_int);
 
-	uart_init(uart_baud, uart_data, uart_stop, uart_parity);
+	uart_fifo_thresholds(config_int(config_id_uart_rx_full), config_int(config_id_uart_rx_timeout), config_int(config_id_uart_tx_empty));
+	uart_flow_control(config_flags_get().flag.uart_flow_control);
+	uart1_init();
 
 	os_install_putc1(&logchar);
 	system_set_os_print(1);
@@ -423,13 +930,10 @@ irom void user_init(void)
 
 irom static void wlan_event_handler(System_Event_t *event)
 {
-	int trigger_io, trigger_pin;
 	io_trigger_t trigger = io_trigger_none;
 	struct ip_info info;
 	ip_addr_to_bytes_t local_ip;
 	ip_addr_to_bytes_t mc_ip;
-	string_init(varname_assoc_io, "trigger.assoc.io");
-	string_init(varname_assoc_pin, "trigger.assoc.pin");
 
 	switch(event->event)
 	{
@@ -464,83 +968,277 @@ irom static void wlan_event_handler(System_Event_t *event)
 		}
 	}
 
-	if((trigger != io_trigger_none) &&
-			(config_get_int(&varname_assoc_io, -1, -1, &trigger_io) &&
-			config_get_int(&varname_assoc_pin, -1, -1, &trigger_pin) &&
-			(trigger_io >= 0) && (trigger_pin >= 0)))
-		io_trigger_pin((string_t *)0, trigger_io, trigger_pin, trigger);
+	if((trigger != io_trigger_none) && (config_int(config_id_trigger_assoc_io) >= 0) && (config_int(config_id_trigger_assoc_pin) >= 0))
+		io_trigger_pin((string_t *)0, config_int(config_id_trigger_assoc_io), config_int(config_id_trigger_assoc_pin), trigger);
 }
 
 // SOCKET CALLBACKS
 
 // received
 
+// these commands carry binary data or are http requests, they're not split into lines
+
+always_inline static bool_t command_is_raw(const string_t *buffer)
+{
+	static const char *raw_command[] = { "GET ", "os ", "ota-send-data ", "flash-send " };
+	unsigned int ix;
+	int length;
+
+	if(binary_is_frame(buffer))
+		return(true);
+
+	for(ix = 0; ix < (sizeof(raw_command) / sizeof(*raw_command)); ix++)
+	{
+		length = strlen(raw_command[ix]);
+
+		if((string_length(buffer) >= length) && !memcmp(string_buffer(buffer), raw_command[ix], length))
+			return(true);
+	}
+
+	return(false);
+}
+
+always_inline static bool_t cmd_input_from(const socket_t *socket)
+{
+	return((socket->remote.proto == cmd_input.remote.proto) &&
+			(socket->remote.child == cmd_input.remote.child) &&
+			(socket->remote.port == cmd_input.remote.port) &&
+			(socket->remote.address.ip_addr.addr == cmd_input.remote.address.ip_addr.addr));
+}
+
 iram attr_speed static void callback_received_cmd(socket_t *socket, const string_t *buffer, void *userdata)
 {
-	if(socket_cmd.state != socket_state_idle)
+	int length = string_length(buffer);
+	bool_t raw, terminate;
+
+	// a raw packet is never split into lines, it can't wait behind queued
+	// lines either, so it's rejected while there are any; input from another
+	// sender is rejected until the current sender's commands have been run
+
+	raw = command_is_raw(buffer);
+
+	if((!queue_empty(&cmd_receive_queue) || (socket_cmd.state != socket_state_idle)) && (raw || !cmd_input_from(socket)))
+	{
+		stat_cmd_receive_rejected++;
+		return;
+	}
+
+	cmd_input.remote = socket->remote;
+
+	if(raw)
+	{
+		socket_cmd.receive_buffer = *buffer;
+		socket_cmd.state = socket_state_received;
+
+		system_os_post(background_task_id, 0, 0);
+		return;
+	}
+
+	// a udp datagram always ends with a complete line
+
+	terminate = (socket_proto(socket) == proto_udp) && (length > 0) && (string_at(buffer, length - 1) != '\n');
+
+	if(queue_space(&cmd_receive_queue) < (length + (terminate ? 1 : 0)))
 	{
 		stat_cmd_receive_buffer_overflow++;
 		return;
 	}
 
-	socket_cmd.receive_buffer = *buffer;
-	socket_cmd.state = socket_state_received;
+	queue_push_n(&cmd_receive_queue, length, string_buffer(buffer));
+
+	if(terminate)
+		queue_push(&cmd_receive_queue, '\n');
+
+	cmd_input.last_received = system_get_time();
+
+	if(!cmd_input.held && (socket_proto(socket) == proto_tcp) && (queue_space(&cmd_receive_queue) < cmd_hold_space))
+	{
+		cmd_input.held = true;
+		socket_hold(socket);
+	}
 
 	system_os_post(background_task_id, 0, 0);
 }
 
+always_inline static void bridge_queue_push_n(int length, const char *data)
+{
+	int queued;
+
+	queued = queue_push_n(&uart_send_queue, length, data);
+	stat_uart_receive_buffer_overflow += length - queued;
+}
+
+// with writers = first the first tcp client that sends data owns the uart
+// until it disconnects, the udp peer may only write while nobody owns it
+
+always_inline static bool_t bridge_may_write(const socket_t *socket, int slot)
+{
+	switch(bridge_clients.writers)
+	{
+		case(bridge_writers_first):
+		{
+			if(slot == bridge_client_udp)
+				return(bridge_clients.writer < 0);
+
+			if(bridge_clients.writer < 0)
+				bridge_clients.writer = slot;
+
+			return(bridge_clients.writer == slot);
+		}
+
+		case(bridge_writers_designated):
+		{
+			return(socket->remote.address.ip_addr.addr == bridge_clients.writer_ip.ip_addr.addr);
+		}
+
+		default:
+		{
+			return(true);
+		}
+	}
+}
+
+// Runs without IAC are pushed as one block, the state machine only
+// runs for the IAC sequences themselves. The state is kept across
+// packets per client, so a sequence split over two segments is handled
+// correctly.
+
 iram static void callback_received_uart(socket_t *socket, const string_t *buffer, void *userdata)
 {
-	int current, length;
+	telnet_strip_state_t *state;
+	const char *data, *iac;
+	int length, slot;
 	uint8_t byte;
-	bool_t strip_telnet;
-	telnet_strip_state_t telnet_strip_state;
 
+	slot = bridge_client_slot(socket);
+
+	if(slot == bridge_client_udp)
+		bridge_clients.udp_peer = socket->remote;
+
+	if(!bridge_may_write(socket, slot))
+	{
+		stat_bridge_writes_refused++;
+		return;
+	}
+
+	state = &bridge_clients.telnet_state[slot];
+	data = string_buffer(buffer);
 	length = string_length(buffer);
 
-	strip_telnet = config_flags_get().flag.strip_telnet;
-	telnet_strip_state = ts_copy;
+	if(!config_flags_get().flag.strip_telnet)
+	{
+		bridge_queue_push_n(length, data);
+		length = 0;
+	}
 
-	for(current = 0; current < length; current++)
+	while(length > 0)
 	{
-		byte = string_at(buffer, current);
+		if(*state == ts_copy)
+		{
+			if(!(iac = memchr(data, telnet_iac, length)))
+			{
+				bridge_queue_push_n(length, data);
+				break;
+			}
+
+			bridge_queue_push_n(iac - data, data);
+			length -= (iac - data) + 1;
+			data = iac + 1;
+			*state = ts_iac;
+			continue;
+		}
 
-		switch(telnet_strip_state)
+		byte = (uint8_t)*data++;
+		length--;
+
+		switch(*state)
 		{
-			case(ts_copy):
+			case(ts_iac):
 			{
-				if(strip_telnet && (byte == 0xff))
-					telnet_strip_state = ts_dodont;
-				else
+				switch(byte)
 				{
-					if(queue_full(&uart_send_queue))
-						stat_uart_receive_buffer_overflow++;
-					else
-						queue_push(&uart_send_queue, byte);
+					case(telnet_iac):
+					{
+						bridge_queue_push_n(1, (const char *)&byte); // escaped 0xff
+						*state = ts_copy;
+						break;
+					}
+					case(telnet_will):
+					case(telnet_wont):
+					case(telnet_do):
+					case(telnet_dont):
+					{
+						*state = ts_option;
+						break;
+					}
+					case(telnet_sb):
+					{
+						*state = ts_sb;
+						break;
+					}
+					default:
+					{
+						*state = ts_copy; // two byte command (NOP, BRK, AYT, ...)
+						break;
+					}
 				}
 
 				break;
 			}
-			case(ts_dodont):
+			case(ts_option):
+			{
+				*state = ts_copy;
+				break;
+			}
+			case(ts_sb):
 			{
-				telnet_strip_state = ts_data;
+				if(byte == telnet_iac)
+					*state = ts_sb_iac;
 				break;
 			}
-			case(ts_data):
+			case(ts_sb_iac):
 			{
-				telnet_strip_state = ts_copy;
+				if(byte == telnet_se)
+					*state = ts_copy;
+				else
+					*state = ts_sb; // escaped 0xff in subnegotiation data
+				break;
+			}
+			default:
+			{
+				*state = ts_copy;
 				break;
 			}
 		}
 	}
 
 	uart_start_transmit(!queue_empty(&uart_send_queue));
+
+	if(!bridge_flow.held && (socket_proto(socket) == proto_tcp) && (queue_space(&uart_send_queue) < bridge_hold_space))
+	{
+		bridge_flow.held = true;
+		bridge_flow.held_since = system_get_time();
+		stat_bridge_holds++;
+		socket_hold(socket);
+		uart_tx_wakeup();
+	}
 }
 
 // sent
 
 iram attr_speed static void callback_sent_cmd(socket_t *socket, void *userdata)
 {
+	if(socket_cmd.state == socket_state_generate_wait)
+		socket_cmd.state = socket_state_generate;
+
+	if((socket_cmd.state == socket_state_send_wait) || (socket_cmd.state == socket_state_generate))
+		system_os_post(background_task_id, 0, 0);
+
+	// act on a reset only after the last reply has gone out
+
+	if(socket_send_pending(socket))
+		return;
+
 	if(reset_state == reset_state_send_reply)
 	{
 		if(socket->remote.proto == proto_udp)
@@ -549,16 +1247,28 @@ iram attr_speed static void callback_sent_cmd(socket_t *socket, void *userdata)
 			reset_state = reset_state_request_tcp_disconnect;
 	}
 
-	socket_cmd.state = socket_state_idle;
+	if(bg_action.disconnect_when_sent && (socket_cmd.state == socket_state_idle))
+	{
+		bg_action.disconnect_when_sent = 0;
+		bg_action.disconnect = 1;
+		system_os_post(background_task_id, 0, 0);
+	}
 }
 
 iram attr_speed static void callback_sent_uart(socket_t *socket, void *userdata)
 {
-	if(!queue_empty(&uart_receive_queue))
-		system_os_post(background_task_id, 0, 0); // retry to send data still in the fifo
+	if(!bridge_client_done(bridge_client_slot(socket)))
+		return;
 
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	// start sending the data that came in meanwhile right away, unless the
+	// send completed from within bridge_send(), the background task sends
+	// the next span then
+
+	if(bridge_clients.starting)
+		return;
+
+	if(background_task_bridge_uart())
+		stat_update_uart++;
 }
 
 // error
@@ -568,13 +1278,22 @@ irom static void callback_error_cmd(socket_t *socket, int error, void *userdata)
 	if(reset_state != reset_state_inactive)
 		reset_state = reset_state_go;
 
+	application_generate_cancel();
+	bg_action.disconnect_when_sent = 0;
 	socket_cmd.state = socket_state_idle;
 }
 
 irom static void callback_error_uart(socket_t *socket, int error, void *userdata)
 {
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	int slot = bridge_client_slot(socket);
+
+	if(bridge_clients.writer == slot)
+		bridge_clients.writer = -1;
+
+	bridge_client_done(slot);
+
+	if((slot != bridge_client_udp) && (socket_children(socket) <= 1))
+		bridge_flow.held = false; // the last connection is gone, nothing to unhold
 }
 
 // disconnect
@@ -584,52 +1303,104 @@ irom static void callback_disconnect_cmd(socket_t *socket, void *userdata)
 	if((reset_state == reset_state_request_tcp_disconnect) || (reset_state == reset_state_wait_tcp_disconnect))
 		reset_state = reset_state_wait;
 
+	application_generate_cancel();
+	bg_action.disconnect_when_sent = 0;
 	socket_cmd.state = socket_state_idle;
+	queue_flush(&cmd_receive_queue);
+	cmd_input.held = false;
 }
 
 irom static void callback_disconnect_uart(socket_t *socket, void *userdata)
 {
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	int slot = bridge_client_slot(socket);
+
+	if(bridge_clients.writer == slot)
+		bridge_clients.writer = -1;
+
+	bridge_client_done(slot);
+
+	if(socket_children(socket) <= 1)
+		bridge_flow.held = false; // the last connection is gone, nothing to unhold
 }
 
 // accept
 
 iram attr_speed static void callback_accept_cmd(socket_t *socket, void *userdata)
 {
+	application_generate_cancel();
+	bg_action.disconnect_when_sent = 0;
 	socket_cmd.state = socket_state_idle;
+	queue_flush(&cmd_receive_queue);
+	cmd_input.held = false;
 }
 
 iram attr_speed static void callback_accept_uart(socket_t *socket, void *userdata)
 {
+	bridge_clients.telnet_state[bridge_client_slot(socket)] = ts_copy;
+
+	// later clients join the running stream
+
+	if(socket_children(socket) > 1)
+	{
+		if(bridge_flow.held)
+			socket_hold(socket);
+
+		return;
+	}
+
+	// uart_send_queue is consumed by the uart interrupt handler,
+	// so it can only be flushed from here with the interrupt masked
+
+	ETS_UART_INTR_DISABLE();
 	queue_flush(&uart_send_queue);
+	ETS_UART_INTR_ENABLE();
+
 	queue_flush(&uart_receive_queue);
 
-	string_clear(&socket_uart.send_buffer);
+	string_set(&socket_uart.send_buffer, (char *)0, 0, 0);
 	socket_uart.state = socket_state_idle;
+	bridge_clients.pending = 0;
+	bridge_clients.writer = -1;
 }
 
 irom static void user_init2(void)
 {
 	int uart_port, uart_timeout;
 	int cmd_port, cmd_timeout;
+	int uart_clients, ix;
+	int cmd_backlog;
+	int framing_mode_int, writers_int;
+
+	uart_port = config_int(config_id_bridge_port);
+	uart_timeout = config_int(config_id_bridge_timeout);
+
+	bridge_coalesce.bytes = config_int(config_id_bridge_coalesce_bytes);
 
-	string_init(varname_bridge_port, "bridge.port");
-	string_init(varname_bridge_timeout, "bridge.timeout");
-	string_init(varname_cmd_port, "cmd.port");
-	string_init(varname_cmd_timeout, "cmd.timeout");
+	if((bridge_coalesce.bytes <= 0) || (bridge_coalesce.bytes > uart_bridge_max_send_length))
+		bridge_coalesce.bytes = uart_bridge_max_send_length;
 
-	if(!config_get_int(&varname_bridge_port, -1, -1, &uart_port))
-		uart_port = 0;
+	bridge_coalesce.time_us = config_int(config_id_bridge_coalesce_time);
 
-	if(!config_get_int(&varname_bridge_timeout, -1, -1, &uart_timeout))
-		uart_timeout = 90;
+	framing_mode_int = config_int(config_id_bridge_framing_mode);
+	bridge_framing.mode = (bridge_framing_t)framing_mode_int;
+	bridge_framing.gap = config_int(config_id_bridge_framing_gap);
+	bridge_framing.delimiter = (char)config_int(config_id_bridge_framing_delimiter);
 
-	if(!config_get_int(&varname_cmd_port, -1, -1, &cmd_port))
-		cmd_port = 24;
+	uart_rx_framing(bridge_framing.mode == bridge_framing_idle, bridge_framing.gap);
 
-	if(!config_get_int(&varname_cmd_timeout, -1, -1, &cmd_timeout))
-		cmd_timeout = 90;
+	uart_clients = config_int(config_id_bridge_clients);
+	writers_int = config_int(config_id_bridge_writers);
+	bridge_clients.writers = (bridge_writers_t)writers_int;
+
+	for(ix = 0; ix < 4; ix++)
+		bridge_clients.writer_ip.byte[ix] = (uint8_t)config_int((config_id_t)(config_id_bridge_writer_ip_0 + ix));
+
+	cmd_port = config_int(config_id_cmd_port);
+	cmd_timeout = config_int(config_id_cmd_timeout);
+	cmd_backlog = config_int(config_id_cmd_backlog);
+
+	if((cmd_backlog < 1) || (cmd_backlog > socket_backlog_max_depth))
+		cmd_backlog = config_int_default(config_id_cmd_backlog);
 
 	if(config_flags_get().flag.cpu_high_speed)
 		system_update_cpu_freq(160);
@@ -641,16 +1412,21 @@ irom static void user_init2(void)
 	wlan_init();
 	time_init();
 	io_init();
+	application_init();
 
-	socket_create(true, true, &socket_cmd.socket, cmd_port, cmd_timeout,
-			callback_received_cmd, callback_sent_cmd, callback_error_cmd, callback_disconnect_cmd, callback_accept_cmd, (void *)&socket_cmd);
+	if(socket_create(true, true, &socket_cmd.socket, cmd_port, cmd_timeout, 1,
+			callback_received_cmd, callback_sent_cmd, callback_error_cmd, callback_disconnect_cmd, callback_accept_cmd, (void *)&socket_cmd))
+		socket_backlog(&socket_cmd.socket, cmd_backlog, sizeof(_socket_cmd_backlog_buffer), _socket_cmd_backlog_buffer);
+	else
+		log("* cannot create command socket on port %d\r\n", cmd_port);
 
 	if(uart_port > 0)
 	{
-		socket_create(true, true, &socket_uart.socket, uart_port, uart_timeout,
-				callback_received_uart, callback_sent_uart, callback_error_uart, callback_disconnect_uart, callback_accept_uart, (void *)&socket_uart);
-
-		uart_bridge_active = true;
+		if(socket_create(true, true, &socket_uart.socket, uart_port, uart_timeout, uart_clients,
+				callback_received_uart, callback_sent_uart, callback_error_uart, callback_disconnect_uart, callback_accept_uart, (void *)&socket_uart))
+			uart_bridge_active = true;
+		else
+			log("* cannot create uart bridge socket on port %d\r\n", uart_port);
 	}
 
 	system_os_task(background_task, background_task_id, background_task_queue, background_task_queue_length);
@@ -660,27 +1436,21 @@ irom static void user_init2(void)
 
 	os_timer_setfn(&fast_timer, fast_timer_callback, (void *)0);
 	os_timer_arm(&fast_timer, 10, 1); // fast system timer / 100 Hz / 10 ms
+
+	os_timer_setfn(&bridge_coalesce_timer, bridge_coalesce_timer_callback, (void *)0); // one shot, armed when data is held back
+	os_timer_setfn(&cmd_partial_line_timer, cmd_partial_line_timer_callback, (void *)0); // one shot, armed when a command has no newline yet
 }
 
 irom bool_t wlan_init(void)
 {
-	int wlan_mode_int;
 	config_wlan_mode_t wlan_mode;
+	int wlan_mode_int;
 	string_new(, config_string, 64);
-	int channel;
 	struct station_config cconf;
 	struct softap_config saconf;
-	string_init(varname_wlan_mode, "wlan.mode");
-	string_init(varname_wlan_client_ssid, "wlan.client.ssid");
-	string_init(varname_wlan_client_passwd, "wlan.client.passwd");
-	string_init(varname_wlan_ap_ssid, "wlan.ap.ssid");
-	string_init(varname_wlan_ap_passwd, "wlan.ap.passwd");
-	string_init(varname_wlan_ap_channel, "wlan.ap.channel");
-
-	if(config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int))
-		wlan_mode = (config_wlan_mode_t)wlan_mode_int;
-	else
-		wlan_mode = config_wlan_mode_client;
+
+	wlan_mode_int = config_int(config_id_wlan_mode);
+	wlan_mode = (config_wlan_mode_t)wlan_mode_int;
 
 	switch(wlan_mode)
 	{
@@ -690,18 +1460,12 @@ irom bool_t wlan_init(void)
 			cconf.bssid_set = 0;
 
 			string_clear(&config_string);
-
-			if(config_get_string(&varname_wlan_client_ssid, -1, -1, &config_string))
-				strecpy(cconf.ssid, string_to_cstr(&config_string), sizeof(cconf.ssid));
-			else
-				strecpy(cconf.ssid, "esp", sizeof(cconf.ssid));
+			config_get_string_id(config_id_wlan_client_ssid, &config_string);
+			strecpy(cconf.ssid, string_to_cstr(&config_string), sizeof(cconf.ssid));
 
 			string_clear(&config_string);
-
-			if(config_get_string(&varname_wlan_client_passwd, -1, -1, &config_string))
-				strecpy(cconf.password, string_to_cstr(&config_string), sizeof(cconf.password));
-			else
-				strecpy(cconf.password, "espespesp", sizeof(cconf.password));
+			config_get_string_id(config_id_wlan_client_passwd, &config_string);
+			strecpy(cconf.password, string_to_cstr(&config_string), sizeof(cconf.password));
 
 			log("* set wlan mode to client, ssid=\"%s\", passwd=\"%s\"\r\n", cconf.ssid, cconf.password);
 
@@ -717,21 +1481,16 @@ irom bool_t wlan_init(void)
 		{
 			memset(&saconf, 0, sizeof(saconf));
 
-			if(config_get_string(&varname_wlan_ap_ssid, -1, -1, &config_string))
-				strecpy(saconf.ssid, string_to_cstr(&config_string), sizeof(saconf.ssid));
-			else
-				strecpy(saconf.ssid, "esp", sizeof(saconf.ssid));
-
-			if(config_get_string(&varname_wlan_ap_passwd, -1, -1, &config_string))
-				strecpy(saconf.password, string_to_cstr(&config_string), sizeof(saconf.password));
-			else
-				strecpy(saconf.password, "espespesp", sizeof(saconf.password));
+			string_clear(&config_string);
+			config_get_string_id(config_id_wlan_ap_ssid, &config_string);
+			strecpy(saconf.ssid, string_to_cstr(&config_string), sizeof(saconf.ssid));
 
-			if(!config_get_int(&varname_wlan_ap_channel, -1, -1, &channel))
-				channel = 1;
+			string_clear(&config_string);
+			config_get_string_id(config_id_wlan_ap_passwd, &config_string);
+			strecpy(saconf.password, string_to_cstr(&config_string), sizeof(saconf.password));
 
 			saconf.ssid_len = strlen(saconf.ssid);
-			saconf.channel = channel;
+			saconf.channel = config_int(config_id_wlan_ap_channel);
 			saconf.authmode = AUTH_WPA_WPA2_PSK;
 			saconf.ssid_hidden = 0;
 			saconf.max_connection = 1;
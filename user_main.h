@@ -12,10 +12,29 @@ enum
 {
 	background_task_id				= USER_TASK_PRIO_0,
 	background_task_queue_length	= 64,
+	uart_send_queue_size			= 2048,
+	uart1_send_queue_size			= 256,
+	uart_receive_queue_size			= 2048,
+	uart_bridge_max_send_length		= uart_receive_queue_size / 2,
 };
 
+typedef enum
+{
+	bridge_framing_none,
+	bridge_framing_idle,
+	bridge_framing_delimiter,
+} bridge_framing_t;
+
+typedef enum
+{
+	bridge_writers_first,
+	bridge_writers_all,
+	bridge_writers_designated,
+} bridge_writers_t;
+
 extern queue_t uart_send_queue;
 extern queue_t uart_receive_queue;
+extern queue_t uart1_send_queue;
 extern os_event_t background_task_queue[background_task_queue_length];
 
 bool_t wlan_init(void);
@@ -121,20 +121,28 @@ irom attr_const const char *onoff(bool_t value)
 irom int dprintf(const char *fmt, ...)
 {
 	va_list ap;
-	int current, n;
+	int n;
 
 	va_start(ap, fmt);
 	n = ets_vsnprintf(flash_dram_buffer, sizeof(flash_dram_buffer), fmt, ap);
 	va_end(ap);
 
-	for(current = 0; current < n; current++)
-		if(!queue_full(&uart_send_queue))
-			queue_push(&uart_send_queue, flash_dram_buffer[current]);
+	if(flags_cache.flag.log_to_uart1)
+	{
+		queue_push_n(&uart1_send_queue, n, flash_dram_buffer);
+		queue_push(&uart1_send_queue, '\r');
+		queue_push(&uart1_send_queue, '\n');
 
-	queue_push(&uart_send_queue, '\r');
-	queue_push(&uart_send_queue, '\n');
+		uart1_start_transmit(!queue_empty(&uart1_send_queue));
+	}
+	else
+	{
+		queue_push_n(&uart_send_queue, n, flash_dram_buffer);
+		queue_push(&uart_send_queue, '\r');
+		queue_push(&uart_send_queue, '\n');
 
-	uart_start_transmit(!queue_empty(&uart_send_queue));
+		uart_start_transmit(!queue_empty(&uart_send_queue));
+	}
 
 	return(n);
 }
@@ -142,7 +150,7 @@ irom int dprintf(const char *fmt, ...)
 irom int log(const char *fmt, ...)
 {
 	va_list ap;
-	int current, n;
+	int n;
 
 	if(config_uses_logbuffer())
 		return(0);
@@ -151,12 +159,17 @@ irom int log(const char *fmt, ...)
 	n = ets_vsnprintf(flash_dram_buffer, sizeof(flash_dram_buffer), fmt, ap);
 	va_end(ap);
 
-	if(flags_cache.flag.log_to_uart)
+	if(flags_cache.flag.log_to_uart1)
 	{
-		for(current = 0; current < n; current++)
-			queue_push(&uart_send_queue, flash_dram_buffer[current]);
-		uart_start_transmit(1);
+		queue_push_n(&uart1_send_queue, n, flash_dram_buffer);
+		uart1_start_transmit(!queue_empty(&uart1_send_queue));
 	}
+	else
+		if(flags_cache.flag.log_to_uart)
+		{
+			queue_push_n(&uart_send_queue, n, flash_dram_buffer);
+			uart_start_transmit(!queue_empty(&uart_send_queue));
+		}
 
 	if(flags_cache.flag.log_to_buffer)
 		string_append_cstr(&logbuffer, flash_dram_buffer);
@@ -169,11 +182,17 @@ iram attr_speed void logchar(char c)
 	if(config_uses_logbuffer())
 		return;
 
-	if(flags_cache.flag.log_to_uart)
+	if(flags_cache.flag.log_to_uart1)
 	{
-		queue_push(&uart_send_queue, c);
-		uart_start_transmit(1);
+		queue_push(&uart1_send_queue, c);
+		uart1_start_transmit(!queue_empty(&uart1_send_queue));
 	}
+	else
+		if(flags_cache.flag.log_to_uart)
+		{
+			queue_push(&uart_send_queue, c);
+			uart_start_transmit(!queue_empty(&uart_send_queue));
+		}
 
 	if(flags_cache.flag.log_to_buffer)
 	{
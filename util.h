@@ -230,6 +230,21 @@ always_inline static bool_t string_space(const string_t *dst)
 	return(dst->length < dst->size);
 }
 
+// Chunked output takes back an item that was cut short, so it can be
+// written again at the start of the next chunk. An item that doesn't fit
+// even when it's the first in a chunk is kept as it is.
+
+always_inline static bool_t string_chunk_fits(string_t *dst, int mark)
+{
+	if((mark == 0) || (dst->length < (dst->size - 2)))
+		return(true);
+
+	dst->length = mark;
+	dst->buffer[mark] = '\0';
+
+	return(false);
+}
+
 always_inline static void string_clear(string_t *dst)
 {
 	dst->length = 0;